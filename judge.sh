@@ -67,6 +67,28 @@ for item in "${list[@]}"; do
 
 done
 
+# Co-simulate with the naive simulator on the machines in ./testcases/cosim
+echo -e "\033[1m====================================================================="
+echo "                          Co-simulation                              "
+echo -e "=====================================================================\033[0m"
+
+for machine in ./testcases/cosim/*.machine; do
+    for item in "${list[@]}"; do
+        # too long to step through
+        if [ "$item" == "pi" ]; then
+            continue
+        fi
+        echo "Co-simulating test[$item] on $machine"
+        ./tmpdir/code --machine "$machine" --duipai ./testcases/$item.data 2> ./testcases/$item.cosim
+        if [ $? -eq 0 ]; then
+            echo -e "\033[32m Testcase $item passed\033[0m"
+        else
+            echo -e "\033[31m Testcase $item failed, see ./testcases/$item.cosim\033[0m"
+            failed_list+=("$item ($machine)")
+        fi
+    done
+done
+
 # Print the failed testcases
 echo -e "\033[1m====================================================================="
 echo "                             Show result                             "
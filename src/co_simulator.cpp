@@ -0,0 +1,103 @@
+#include "co_simulator.h"
+#include "naive_simulator.h"
+#include "simulator.h"
+#include "utils/utils.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace jasonfxz {
+
+CoSimulator::CoSimulator(const MachineDesc &desc, int interval, int window, int keep)
+    : desc(desc), interval(interval), window(window), keep(keep) {}
+
+void CoSimulator::Init(std::istream &is) {
+    program.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    Restart();
+    checkpoints.clear();
+}
+
+void CoSimulator::Restart() {
+    sim = MakeSimulator(desc);
+    nsim = std::make_unique<NSimulator>();
+    std::istringstream is(program);
+    sim->Init(is);
+    is.clear();
+    is.str(program);
+    nsim->Init(is);
+    step_count = 0;
+    last = DebugRecord{};
+}
+
+int CoSimulator::Step(DebugRecord &ans, DebugRecord &out) {
+    bool nflag = nsim->Step(ans);
+    bool flag = sim->Step(out);
+    if (nflag != flag) return 1;
+    if (!nflag) return 2;
+    return ans == out ? 0 : 1;
+}
+
+bool CoSimulator::Run(std::ostream &os) {
+    DebugRecord ans, out;
+    while (true) {
+        if (step_count > 0 && step_count % interval == 0) {
+            checkpoints.push_back(std::make_unique<Checkpoint>(*sim, *nsim, step_count, last));
+            if ((int)checkpoints.size() > keep) checkpoints.pop_front();
+        }
+        ++step_count;
+        int res = Step(ans, out);
+        if (res == 2) {
+            os << "Same output, " << step_count - 1 << " commits in " << sim->Clock() << " cycles" << std::endl;
+            return true;
+        }
+        if (res == 1) {
+            Replay(os, step_count, sim->Clock());
+            return false;
+        }
+        last = ans;
+    }
+}
+
+void CoSimulator::Replay(std::ostream &os, long long fail_step, int fail_clock) {
+    int from_clock = std::max(0, fail_clock - window);
+    const Checkpoint *from = nullptr;
+    for (const auto &cp : checkpoints) {
+        if (cp->sim->Clock() <= from_clock) from = cp.get();
+    }
+    if (from == nullptr && !checkpoints.empty() && checkpoints.front()->step_count != interval) {
+        // the start of the program is not kept any more, trace as much as we have
+        from = checkpoints.front().get();
+    }
+    if (from != nullptr) {
+        sim->LoadSnapshot(*from->sim);
+        *nsim = from->nsim;
+        step_count = from->step_count;
+        last = from->last;
+    } else {
+        Restart();
+    }
+    os << "Different output at commit " << fail_step << " (clock " << fail_clock << "), replaying from commit "
+       << step_count << " (clock " << sim->Clock() << ") with trace from clock " << from_clock << std::endl;
+#ifndef DEBUG
+    os << "(build with -DCMAKE_BUILD_TYPE=Debug to get the trace)" << std::endl;
+#endif
+    sim->debug_from_clock = from_clock;
+    DebugRecord ans, out;
+    while (step_count < fail_step) {
+        nsim->enable_debug = sim->enable_debug;
+        ++step_count;
+        Step(ans, out);
+        if (step_count < fail_step) last = ans;
+    }
+    os << "Different output" << std::endl;
+    ans.Print();
+    os << "vs" << std::endl;
+    out.Print();
+    os << "LAST OUTPUT" << std::endl;
+    last.Print();
+    os << "At step " << fail_step << std::endl;
+}
+
+} // namespace jasonfxz
@@ -0,0 +1,331 @@
+#include "config/machine_desc.h"
+#include "circuits/bus.h"
+#include "units/branch_predictor.h"
+#include "units/cache.h"
+#include "units/prefetcher.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace jasonfxz {
+
+MachineDesc MachineDesc::Named(const std::string &name) {
+#define FROM_NAME(Config, config_name) if (name == config_name) return From<Config>();
+    FOR_EACH_MACHINE_CONFIG(FROM_NAME)
+#undef FROM_NAME
+    throw std::runtime_error("Unknown machine config: " + name);
+}
+
+void MachineDesc::Set(const std::string &key, int value) {
+    if (key == "rob_size") rob_size = value;
+    else if (key == "rs_size") rs_size = value;
+    else if (key == "lsb_size") lsb_size = value;
+    else if (key == "ins_size") ins_size = value;
+    else if (key == "cdb_width") cdb_width = value;
+    else if (key == "add_latency") add_latency = value;
+    else if (key == "camp_latency") camp_latency = value;
+    else if (key == "logic_latency") logic_latency = value;
+    else if (key == "shift_latency") shift_latency = value;
+    else if (key == "load_latency") load_latency = value;
+    else if (key == "store_latency") store_latency = value;
+    else if (key == "add_units") add_units = value;
+    else if (key == "camp_units") camp_units = value;
+    else if (key == "logic_units") logic_units = value;
+    else if (key == "shift_units") shift_units = value;
+    else if (key == "mul_units") mul_units = value;
+    else if (key == "mul_latency") mul_latency = value;
+    else if (key == "div_units") div_units = value;
+    else if (key == "div_latency") div_latency = value;
+    else if (key == "agu_units") agu_units = value;
+    else if (key == "agu_latency") agu_latency = value;
+    else if (key == "fetch_width") fetch_width = value;
+    else if (key == "issue_width") issue_width = value;
+    else if (key == "commit_width") commit_width = value;
+    else if (key == "rob_read_ports") rob_read_ports = value;
+    else if (key == "load_ports") load_ports = value;
+    else if (key == "outstanding_loads") outstanding_loads = value;
+    else if (key == "store_buffer") store_buffer = value;
+    else if (key == "predictor_size") predictor_size = value;
+    else if (key == "btb_size") btb_size = value;
+    else if (key == "ras_size") ras_size = value;
+    else if (key == "ittage_size") ittage_size = value;
+    else if (key == "ssit_size") ssit_size = value;
+    else if (key == "lfst_size") lfst_size = value;
+    else if (key == "icache_size") icache_size = value;
+    else if (key == "icache_assoc") icache_assoc = value;
+    else if (key == "icache_line") icache_line = value;
+    else if (key == "icache_hit_latency") icache_hit_latency = value;
+    else if (key == "icache_miss_latency") icache_miss_latency = value;
+    else if (key == "fetch_buffer") fetch_buffer = value;
+    else if (key == "dcache_size") dcache_size = value;
+    else if (key == "dcache_assoc") dcache_assoc = value;
+    else if (key == "dcache_line") dcache_line = value;
+    else if (key == "dcache_hit_latency") dcache_hit_latency = value;
+    else if (key == "dcache_miss_latency") dcache_miss_latency = value;
+    else if (key == "dcache_mshrs") dcache_mshrs = value;
+    else if (key == "prefetch_degree") prefetch_degree = value;
+    else if (key == "prefetch_table") prefetch_table = value;
+    else if (key == "prefetch_streams") prefetch_streams = value;
+    else if (key == "l2_size") l2_size = value;
+    else if (key == "l2_assoc") l2_assoc = value;
+    else if (key == "l2_line") l2_line = value;
+    else if (key == "l2_hit_latency") l2_hit_latency = value;
+    else if (key == "l2_miss_latency") l2_miss_latency = value;
+    else if (key == "dram_banks") dram_banks = value;
+    else if (key == "dram_row_size") dram_row_size = value;
+    else if (key == "dram_row_hit_latency") dram_row_hit_latency = value;
+    else if (key == "dram_row_miss_latency") dram_row_miss_latency = value;
+    else if (key == "dram_row_conflict_latency") dram_row_conflict_latency = value;
+    else if (key == "dram_queue") dram_queue = value;
+    else if (key == "predictor" || key == "prefetcher" || key == "cdb_policy") throw std::runtime_error(key + " needs a name");
+    else if (key == "icache_policy" || key == "dcache_policy" || key == "l2_policy") throw std::runtime_error(key + " needs a name");
+    else throw std::runtime_error("Unknown machine description key: " + key);
+}
+
+void MachineDesc::Set(const std::string &key, const std::string &value) {
+    if (key == "predictor") {
+        predictor = value;
+        return;
+    }
+    if (key == "prefetcher") {
+        prefetcher = value;
+        return;
+    }
+    if (key == "cdb_policy") {
+        cdb_policy = value;
+        return;
+    }
+    if (key == "icache_policy") {
+        icache_policy = value;
+        return;
+    }
+    if (key == "dcache_policy") {
+        dcache_policy = value;
+        return;
+    }
+    if (key == "l2_policy") {
+        l2_policy = value;
+        return;
+    }
+    size_t end = 0;
+    int number = 0;
+    try {
+        number = std::stoi(value, &end);
+    } catch (const std::logic_error &) {
+        end = 0;
+    }
+    if (end == 0 || end != value.size()) throw std::runtime_error(key + " needs an integer value");
+    Set(key, number);
+}
+
+void MachineDesc::Load(std::istream &is) {
+    std::string line;
+    int line_no = 0;
+    while (std::getline(is, line)) {
+        ++line_no;
+        auto comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        auto eq = line.find('=');
+        std::istringstream key_ss(line.substr(0, eq));
+        std::string key, rest;
+        if (!(key_ss >> key)) continue; // empty line
+        if (eq == std::string::npos) {
+            throw std::runtime_error("Line " + std::to_string(line_no) + ": expect `key = value`");
+        }
+        std::istringstream value_ss(line.substr(eq + 1));
+        std::string value;
+        if (!(value_ss >> value) || (value_ss >> rest)) {
+            throw std::runtime_error("Line " + std::to_string(line_no) + ": " + key + " needs one value");
+        }
+        try {
+            Set(key, value);
+        } catch (const std::runtime_error &e) {
+            throw std::runtime_error("Line " + std::to_string(line_no) + ": " + e.what());
+        }
+    }
+    Validate();
+}
+
+void MachineDesc::Validate() const {
+    auto at_least = [](const char *key, int value, int min) {
+        if (value < min) {
+            throw std::runtime_error(std::string(key) + " = " + std::to_string(value)
+                                     + ", should be at least " + std::to_string(min));
+        }
+    };
+    at_least("rob_size", rob_size, 1);
+    at_least("rs_size", rs_size, 1);
+    at_least("lsb_size", lsb_size, 1);
+    at_least("ins_size", ins_size, 1);
+    at_least("fetch_width", fetch_width, 1);
+    at_least("issue_width", issue_width, 1);
+    at_least("commit_width", commit_width, 1);
+    at_least("rob_read_ports", rob_read_ports, 1);
+    at_least("add_units", add_units, 1);
+    at_least("camp_units", camp_units, 1);
+    at_least("logic_units", logic_units, 1);
+    at_least("shift_units", shift_units, 1);
+    at_least("mul_units", mul_units, 1);
+    at_least("div_units", div_units, 1);
+    at_least("agu_units", agu_units, 1);
+    // the commits, and one slot to arbitrate
+    at_least("cdb_width", cdb_width, commit_width + 1);
+    BusPolicyFrom(cdb_policy);
+    at_least("add_latency", add_latency, 1);
+    at_least("camp_latency", camp_latency, 1);
+    at_least("logic_latency", logic_latency, 1);
+    at_least("shift_latency", shift_latency, 1);
+    at_least("mul_latency", mul_latency, 1);
+    at_least("div_latency", div_latency, 1);
+    at_least("agu_latency", agu_latency, 1);
+    at_least("load_latency", load_latency, 1);
+    at_least("store_latency", store_latency, 1);
+    at_least("load_ports", load_ports, 1);
+    at_least("outstanding_loads", outstanding_loads, 1);
+    at_least("store_buffer", store_buffer, 0);
+    at_least("predictor_size", predictor_size, 1);
+    at_least("btb_size", btb_size, 0);
+    at_least("ras_size", ras_size, 0);
+    at_least("ittage_size", ittage_size, 0);
+    at_least("ssit_size", ssit_size, 0);
+    at_least("lfst_size", lfst_size, 1);
+    auto names = PredictorNames();
+    if (std::find(names.begin(), names.end(), predictor) == names.end()) {
+        throw std::runtime_error("Unknown predictor: " + predictor);
+    }
+    if (predictor_size & (predictor_size - 1)) {
+        throw std::runtime_error("predictor_size = " + std::to_string(predictor_size) + ", should be a power of 2");
+    }
+    if (btb_size & (btb_size - 1)) {
+        throw std::runtime_error("btb_size = " + std::to_string(btb_size) + ", should be a power of 2");
+    }
+    if (ittage_size & (ittage_size - 1)) {
+        throw std::runtime_error("ittage_size = " + std::to_string(ittage_size) + ", should be a power of 2");
+    }
+    if (ssit_size & (ssit_size - 1)) {
+        throw std::runtime_error("ssit_size = " + std::to_string(ssit_size) + ", should be a power of 2");
+    }
+    if (lfst_size & (lfst_size - 1)) {
+        throw std::runtime_error("lfst_size = " + std::to_string(lfst_size) + ", should be a power of 2");
+    }
+    auto check_cache = [&](const std::string &name, int size, int assoc, int line, const std::string &policy,
+                           int hit_latency, int miss_latency) {
+        ReplacePolicyFrom(policy);
+        if (size == 0) return;
+        at_least((name + "_assoc").c_str(), assoc, 1);
+        at_least((name + "_line").c_str(), line, 4);
+        at_least((name + "_size").c_str(), size, assoc * line);
+        at_least((name + "_hit_latency").c_str(), hit_latency, 1);
+        at_least((name + "_miss_latency").c_str(), miss_latency, hit_latency);
+        for (auto [key, value] : {std::pair<std::string, int>{name + "_size", size},
+                                  {name + "_assoc", assoc}, {name + "_line", line}}) {
+            if (value & (value - 1)) {
+                throw std::runtime_error(key + " = " + std::to_string(value) + ", should be a power of 2");
+            }
+        }
+    };
+    check_cache("icache", icache_size, icache_assoc, icache_line, icache_policy, icache_hit_latency,
+                icache_miss_latency);
+    at_least("fetch_buffer", fetch_buffer, 1);
+    check_cache("dcache", dcache_size, dcache_assoc, dcache_line, dcache_policy, dcache_hit_latency,
+                dcache_miss_latency);
+    at_least("dcache_mshrs", dcache_mshrs, 1);
+    auto prefetchers = PrefetcherNames();
+    if (std::find(prefetchers.begin(), prefetchers.end(), prefetcher) == prefetchers.end()) {
+        throw std::runtime_error("Unknown prefetcher: " + prefetcher);
+    }
+    at_least("prefetch_degree", prefetch_degree, 1);
+    at_least("prefetch_table", prefetch_table, 1);
+    at_least("prefetch_streams", prefetch_streams, 1);
+    if (prefetch_table & (prefetch_table - 1)) {
+        throw std::runtime_error("prefetch_table = " + std::to_string(prefetch_table) + ", should be a power of 2");
+    }
+    check_cache("l2", l2_size, l2_assoc, l2_line, l2_policy, l2_hit_latency, l2_miss_latency);
+    at_least("dram_banks", dram_banks, 0);
+    if (dram_banks != 0) {
+        at_least("dram_row_size", dram_row_size, 64);
+        at_least("dram_row_hit_latency", dram_row_hit_latency, 1);
+        at_least("dram_row_miss_latency", dram_row_miss_latency, dram_row_hit_latency);
+        at_least("dram_row_conflict_latency", dram_row_conflict_latency, dram_row_miss_latency);
+        at_least("dram_queue", dram_queue, 1);
+        for (auto [key, value] : {std::pair<std::string, int>{"dram_banks", dram_banks},
+                                  {"dram_row_size", dram_row_size}}) {
+            if (value & (value - 1)) {
+                throw std::runtime_error(key + " = " + std::to_string(value) + ", should be a power of 2");
+            }
+        }
+    }
+}
+
+void MachineDesc::Print(std::ostream &os) const {
+    os << "rob_size = " << rob_size << std::endl;
+    os << "rs_size = " << rs_size << std::endl;
+    os << "lsb_size = " << lsb_size << std::endl;
+    os << "ins_size = " << ins_size << std::endl;
+    os << "cdb_width = " << cdb_width << std::endl;
+    os << "cdb_policy = " << cdb_policy << std::endl;
+    os << "add_latency = " << add_latency << std::endl;
+    os << "camp_latency = " << camp_latency << std::endl;
+    os << "logic_latency = " << logic_latency << std::endl;
+    os << "shift_latency = " << shift_latency << std::endl;
+    os << "load_latency = " << load_latency << std::endl;
+    os << "store_latency = " << store_latency << std::endl;
+    os << "add_units = " << add_units << std::endl;
+    os << "camp_units = " << camp_units << std::endl;
+    os << "logic_units = " << logic_units << std::endl;
+    os << "shift_units = " << shift_units << std::endl;
+    os << "mul_units = " << mul_units << std::endl;
+    os << "mul_latency = " << mul_latency << std::endl;
+    os << "div_units = " << div_units << std::endl;
+    os << "div_latency = " << div_latency << std::endl;
+    os << "agu_units = " << agu_units << std::endl;
+    os << "agu_latency = " << agu_latency << std::endl;
+    os << "fetch_width = " << fetch_width << std::endl;
+    os << "issue_width = " << issue_width << std::endl;
+    os << "commit_width = " << commit_width << std::endl;
+    os << "rob_read_ports = " << rob_read_ports << std::endl;
+    os << "load_ports = " << load_ports << std::endl;
+    os << "outstanding_loads = " << outstanding_loads << std::endl;
+    os << "store_buffer = " << store_buffer << std::endl;
+    os << "predictor = " << predictor << std::endl;
+    os << "predictor_size = " << predictor_size << std::endl;
+    os << "btb_size = " << btb_size << std::endl;
+    os << "ras_size = " << ras_size << std::endl;
+    os << "ittage_size = " << ittage_size << std::endl;
+    os << "ssit_size = " << ssit_size << std::endl;
+    os << "lfst_size = " << lfst_size << std::endl;
+    os << "icache_size = " << icache_size << std::endl;
+    os << "icache_assoc = " << icache_assoc << std::endl;
+    os << "icache_line = " << icache_line << std::endl;
+    os << "icache_policy = " << icache_policy << std::endl;
+    os << "icache_hit_latency = " << icache_hit_latency << std::endl;
+    os << "icache_miss_latency = " << icache_miss_latency << std::endl;
+    os << "fetch_buffer = " << fetch_buffer << std::endl;
+    os << "dcache_size = " << dcache_size << std::endl;
+    os << "dcache_assoc = " << dcache_assoc << std::endl;
+    os << "dcache_line = " << dcache_line << std::endl;
+    os << "dcache_policy = " << dcache_policy << std::endl;
+    os << "dcache_hit_latency = " << dcache_hit_latency << std::endl;
+    os << "dcache_miss_latency = " << dcache_miss_latency << std::endl;
+    os << "dcache_mshrs = " << dcache_mshrs << std::endl;
+    os << "prefetcher = " << prefetcher << std::endl;
+    os << "prefetch_degree = " << prefetch_degree << std::endl;
+    os << "prefetch_table = " << prefetch_table << std::endl;
+    os << "prefetch_streams = " << prefetch_streams << std::endl;
+    os << "l2_size = " << l2_size << std::endl;
+    os << "l2_assoc = " << l2_assoc << std::endl;
+    os << "l2_line = " << l2_line << std::endl;
+    os << "l2_policy = " << l2_policy << std::endl;
+    os << "l2_hit_latency = " << l2_hit_latency << std::endl;
+    os << "l2_miss_latency = " << l2_miss_latency << std::endl;
+    os << "dram_banks = " << dram_banks << std::endl;
+    os << "dram_row_size = " << dram_row_size << std::endl;
+    os << "dram_row_hit_latency = " << dram_row_hit_latency << std::endl;
+    os << "dram_row_miss_latency = " << dram_row_miss_latency << std::endl;
+    os << "dram_row_conflict_latency = " << dram_row_conflict_latency << std::endl;
+    os << "dram_queue = " << dram_queue << std::endl;
+}
+
+} // namespace jasonfxz
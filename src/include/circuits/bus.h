@@ -14,31 +14,139 @@
 
 #include "config/types.h"
 #include "carray.h"
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace jasonfxz {
 
 enum class BusType {
-    WriteBack,  // Write back to ROB (Load / ALU)
-    GetAddr,    // Get address for LSB
+    WriteBack,  // Write back to ROB (Load / ALU / data of a STORE)
     // Executing,  // Execute
     CommitReg,     // ROB Commit to register file
     CommitMem,   // Store to memory
     StoreSuccess,  // Store success
+    JumpTarget,    // Target of a JALR to ROB (its rd is pc + 4, known at issue)
 };
 
 struct BusInter {
     BusType type;
     int data;
     int pos;
+    SeqType seq{-1}; // of the producer, so that a squash can drop it (-1: committed already)
 };
 
 
+// who asks for a slot, for the statistics and the round-robin order
+enum class BusProducer {
+    AluAdd,
+    AluCamp,
+    AluLogic,
+    AluShift,
+    AluMul,
+    AluDiv,
+    Agu,   // the data of a STORE
+    Load,
+    Store, // StoreSuccess
+    Count,
+};
+
+inline const char *BusProducerName(BusProducer producer) {
+    static const char *names[] = {"alu_add", "alu_camp", "alu_logic", "alu_shift", "alu_mul",
+                                  "alu_div", "agu",      "load",      "store"};
+    return names[(int)producer];
+}
+
+enum class BusPolicy {
+    Age,        // the oldest instruction first
+    RoundRobin, // the producers take turns to go first, the oldest first within one
+};
+
+// "age" | "round_robin", throw std::runtime_error if unknown
+inline BusPolicy BusPolicyFrom(const std::string &name) {
+    if (name == "age") return BusPolicy::Age;
+    if (name == "round_robin") return BusPolicy::RoundRobin;
+    throw std::runtime_error("Unknown CDB policy: " + name);
+}
+
+/**
+ * `e` holds what was put on the bus in the last cycle, every unit reads it in
+ * its Flush. In Execute a producer asks for a slot with Request(); once every
+ * unit has run, Arbitrate() hands the free slots to the requests by the policy.
+ * A producer that finds in its next Flush that it was not Granted() keeps its
+ * result and asks again. The commits of the ROB are put into `e` directly,
+ * the slots they take are never given away (they are the oldest anyway).
+ */
 template <size_t width>
 struct Bus {
     Carray<BusInter, width> e;
+    BusPolicy policy{BusPolicy::Age};
+
+    void Resize(int len) {
+        e.Resize(len);
+        occupancy.assign(len + 1, 0);
+    }
+    // a ticket for Granted()
+    int Request(BusProducer producer, const BusInter &inter) {
+        claims.push_back({producer, inter, false});
+        return claims.size() - 1;
+    }
+    bool Granted(int ticket) const { return claims[ticket].granted; }
+    // after every unit's Execute
+    void Arbitrate() {
+        order.clear();
+        for (size_t i = 0; i < claims.size(); ++i) order.push_back(i);
+        auto rank = [&](int i) {
+            return policy == BusPolicy::RoundRobin ? ((int)claims[i].producer - first + (int)BusProducer::Count)
+                                                             % (int)BusProducer::Count
+                                                   : 0;
+        };
+        // seq -1 (committed already) goes first
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return rank(a) != rank(b) ? rank(a) < rank(b) : claims[a].inter.seq < claims[b].inter.seq;
+        });
+        for (int i : order) {
+            auto &claim = claims[i];
+            ++requested[(int)claim.producer];
+            claim.granted = e.insert(claim.inter);
+            lost[(int)claim.producer] += !claim.granted;
+        }
+        first = (first + 1) % (int)BusProducer::Count;
+        ++occupancy[e.count()];
+    }
+    // after every unit's Flush
+    void Clear() {
+        e.clear();
+        claims.clear();
+    }
+    // cdb_occupancy.<n> (cycles with n slots taken), cdb_<producer>_requests / _lost, as `key = value`
+    void PrintStats(std::ostream &os) const {
+        for (size_t taken = 0; taken < occupancy.size(); ++taken) {
+            os << "cdb_occupancy." << taken << " = " << occupancy[taken] << std::endl;
+        }
+        for (int i = 0; i < (int)BusProducer::Count; ++i) {
+            os << "cdb_" << BusProducerName((BusProducer)i) << "_requests = " << requested[i] << std::endl;
+            os << "cdb_" << BusProducerName((BusProducer)i) << "_lost = " << lost[i] << std::endl;
+        }
+    }
+
+  private:
+    struct Claim {
+        BusProducer producer;
+        BusInter inter;
+        bool granted;
+    };
+    std::vector<Claim> claims; // asked for in this cycle, the tickets index it
+    std::vector<int> order;        // Arbitrate(), scratch
+    int first{0};                  // RoundRobin: the producer that goes first
+    std::vector<long long> occupancy;
+    long long requested[(int)BusProducer::Count]{}, lost[(int)BusProducer::Count]{};
 };
 
-using CdBus = Bus<8>;
+template <typename Config>
+using CdBus = Bus<Config::CDB_WIDTH>;
 
 }
 
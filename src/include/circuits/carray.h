@@ -12,15 +12,22 @@
 #ifndef CARRAY_H
 #define CARRAY_H
 
+#include "config/constant.h"
+#include <array>
+#include <stdexcept>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace jasonfxz {
 
 
+// LEN == DYNAMIC_SIZE: the size is given at runtime by Resize()
 template <typename Tp, int LEN>
 class Carray {
   private:
-    std::pair<bool, Tp> data[LEN];
+    std::conditional_t<LEN == DYNAMIC_SIZE, std::vector<std::pair<bool, Tp>>, std::array<std::pair<bool, Tp>, LEN>> data;
+    int _len = LEN;
     int _count;
 
   public:
@@ -29,12 +36,24 @@ class Carray {
     Carray() {
         clear();
     }
-    int size() const { return LEN; }
+    void Resize(int len) {
+        if constexpr (LEN == DYNAMIC_SIZE) {
+            _len = len;
+            data.resize(len);
+            clear();
+        } else if (len != LEN) {
+            throw std::runtime_error("Carray: size is fixed at compile time");
+        }
+    }
+    int size() const {
+        if constexpr (LEN == DYNAMIC_SIZE) return _len;
+        else return LEN;
+    }
     int count() const { return _count; }
     bool busy(int index) const { return data[index].first; }
     Tp &operator[](int index) { return data[index].second; }
     bool full() const {
-        for (int i = 0; i < LEN; i++) {
+        for (int i = 0; i < size(); i++) {
             if (!data[i].first) {
                 return false;
             }
@@ -64,7 +83,7 @@ class Carray {
 
     }
     bool insert(const Tp &value) {
-        for (int i = 0; i < LEN; i++) {
+        for (int i = 0; i < size(); i++) {
             if (!data[i].first) {
                 data[i].first = true;
                 data[i].second = value;
@@ -75,13 +94,13 @@ class Carray {
         return false;
     }
     void clear() {
-        for (int i = 0; i < LEN; i++) {
+        for (int i = 0; i < size(); i++) {
             data[i].first = false;
         }
         _count = 0;
     }
     iterator begin() { return iterator(this, 0); }
-    iterator end() { return iterator(this, LEN); }
+    iterator end() { return iterator(this, size()); }
 
     class iterator {
       private:
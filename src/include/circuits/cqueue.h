@@ -12,45 +12,74 @@
 #ifndef CQUEUE_H
 #define CQUEUE_H
 
+#include "config/constant.h"
+#include <array>
 #include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 
 namespace jasonfxz {
 
+// LEN == DYNAMIC_SIZE: the capacity is given at runtime by Resize()
 template <typename Tp, int LEN>
 class Cqueue {
   private:
-    Tp _data[LEN + 1];
+    std::conditional_t<LEN == DYNAMIC_SIZE, std::vector<Tp>, std::array<Tp, LEN + 1>> _data;
+    int _len = LEN;
     int _head = 0;
     int _tail = 0;
 
+    int len() const {
+        if constexpr (LEN == DYNAMIC_SIZE) return _len;
+        else return LEN;
+    }
+
   public:
     class iterator;
     class const_iterator;
 
-    int cap() const { return LEN; }
-    int size() const { return (_tail - _head + LEN + 1) % (LEN + 1); }
+    void Resize(int cap) {
+        if constexpr (LEN == DYNAMIC_SIZE) {
+            _len = cap;
+            _data.assign(cap + 1, Tp());
+            clear();
+        } else if (cap != LEN) {
+            throw std::runtime_error("Cqueue: capacity is fixed at compile time");
+        }
+    }
+    int cap() const { return len(); }
+    int size() const { return (_tail - _head + len() + 1) % (len() + 1); }
     bool empty() const { return _head == _tail; }
-    bool full() const { return (_tail + 1) % (LEN + 1) == _head; }
+    bool full() const { return (_tail + 1) % (len() + 1) == _head; }
     bool push(const Tp& value) {
         if (full()) {
             return false;
         }
         _data[_tail] = value;
-        _tail = (_tail + 1) % (LEN + 1);
+        _tail = (_tail + 1) % (len() + 1);
         return true;
     }
     bool pop() {
         if (empty()) {
             return false;
         }
-        _head = (_head + 1) % (LEN + 1);
+        _head = (_head + 1) % (len() + 1);
+        return true;
+    }
+    // drop the newest element
+    bool pop_back() {
+        if (empty()) {
+            return false;
+        }
+        _tail = (_tail + len()) % (len() + 1);
         return true;
     }
     int head() const { return _head; }
     int tail() const { return _tail; }
     Tp& front() { return _data[_head]; }
-    Tp& back() { return _data[(_tail + LEN) % (LEN + 1)]; }
+    Tp& back() { return _data[(_tail + len()) % (len() + 1)]; }
     iterator begin() { return iterator(this, _head); }
     iterator end() { return iterator(this, _tail); }
     
@@ -76,7 +105,7 @@ class Cqueue {
       public:
         friend Cqueue;
         iterator &operator++() {
-            _idx = (_idx + 1) % (LEN + 1);
+            _idx = (_idx + 1) % (_queue->len() + 1);
             return *this;
         }
         iterator operator++(int) {
@@ -104,7 +133,7 @@ class Cqueue {
         friend Cqueue;
         const_iterator(iterator it) : _queue(it._queue), _idx(it._idx) {}
         const_iterator &operator++() {
-            _idx = (_idx + 1) % (LEN + 1);
+            _idx = (_idx + 1) % (_queue->len() + 1);
             return *this;
         }
         const_iterator operator++(int) {
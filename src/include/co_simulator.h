@@ -0,0 +1,68 @@
+/**
+ * @file co_simulator.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief run the Tomasulo simulator against the naive one (duipai)
+ * @version 0.1
+ * @date 2024-08-05
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef CO_SIMULATOR_H
+#define CO_SIMULATOR_H
+
+#include "config/machine_desc.h"
+#include "naive_simulator.h"
+#include "simulator.h"
+#include "utils/utils.h"
+#include <deque>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace jasonfxz {
+
+/**
+ * Both models are stepped commit by commit and compared.
+ * Every `interval` commits a snapshot of both models is kept (at most `keep` of them).
+ * On a mismatch the latest snapshot at least `window` cycles before the failing
+ * cycle is loaded back, and only that part is replayed with enable_debug on
+ * (the trace itself is only printed by a DEBUG build).
+ */
+class CoSimulator {
+  public:
+    CoSimulator(const MachineDesc &desc, int interval, int window, int keep);
+    void Init(std::istream &is);
+    // true if both models commit the same instructions until halt
+    bool Run(std::ostream &os);
+
+  private:
+    struct Checkpoint {
+        Checkpoint(const BaseSimulator &sim, const NSimulator &nsim, long long step_count, const DebugRecord &last)
+            : sim(sim.SaveSnapshot()), nsim(nsim), step_count(step_count), last(last) {}
+        std::unique_ptr<BaseSimulator::Snapshot> sim;
+        NSimulator nsim;
+        long long step_count;
+        DebugRecord last;
+    };
+
+    void Restart();
+    // 0: same, 1: different, 2: both halt
+    int Step(DebugRecord &ans, DebugRecord &out);
+    void Replay(std::ostream &os, long long fail_step, int fail_clock);
+
+    MachineDesc desc;
+    int interval, window, keep;
+    std::string program;
+    std::unique_ptr<BaseSimulator> sim;
+    std::unique_ptr<NSimulator> nsim;
+    std::deque<std::unique_ptr<Checkpoint>> checkpoints;
+    long long step_count{0};
+    DebugRecord last{};
+};
+
+} // namespace jasonfxz
+
+#endif // CO_SIMULATOR_H
@@ -43,14 +43,9 @@ Callee saved registers (except x0, gp, tp)
 */
 const int REG_FILE_SIZE = 32; // 32 registers
 
-const int MAX_RS_SIZE = 8; // Reservation Station : 8 entries
-
-const int MAX_LSB_SIZE = 8; // Load Store Buffer : 8 entries
-
-const int MAX_INS_SIZE = 32; // Instruction Queue : 32 entries
-
-const int MAX_ROB_SIZE = 32; // ROB QUEUE : 32 entries
+// Buffer sizes / latencies of the OoO core live in config/machine_config.h
 
+const int DYNAMIC_SIZE = 0; // Cqueue / Carray length only known at runtime (see MachineDesc)
 
 
 } // namespace jasonfxz
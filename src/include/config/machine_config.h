@@ -0,0 +1,63 @@
+/**
+ * @file machine_config.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief compile-time machine configurations
+ * @version 0.1
+ * @date 2024-08-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef MACHINE_CONFIG_H
+#define MACHINE_CONFIG_H
+
+#include "config/constant.h"
+
+namespace jasonfxz {
+
+/**
+ * Every Simulator<Config> and its units take the buffer sizes from Config,
+ * so the loops over the queues are constant-folded for each configuration.
+ * The latencies are only the defaults of MachineDesc::From<Config>().
+ */
+template <int RobSize, int RsSize, int LsbSize, int InsSize, int CdbWidth,
+          int AddLatency = 1, int CampLatency = 1, int LogicLatency = 1, int ShiftLatency = 1,
+          int LoadLatency = 3, int StoreLatency = 3>
+struct MachineConfig {
+    static constexpr int MAX_ROB_SIZE = RobSize; // ROB QUEUE
+    static constexpr int MAX_RS_SIZE = RsSize;   // Reservation Station (each)
+    static constexpr int MAX_LSB_SIZE = LsbSize; // Load Store Buffer (load / store queue each)
+    static constexpr int MAX_INS_SIZE = InsSize; // Instruction Queue
+    static constexpr int CDB_WIDTH = CdbWidth;   // Common Data Bus slots
+
+    static constexpr int ADD_LATENCY = AddLatency;
+    static constexpr int CAMP_LATENCY = CampLatency;
+    static constexpr int LOGIC_LATENCY = LogicLatency;
+    static constexpr int SHIFT_LATENCY = ShiftLatency;
+    static constexpr int LOAD_LATENCY = LoadLatency;
+    static constexpr int STORE_LATENCY = StoreLatency;
+};
+
+//                                ROB  RS  LSB  INS  CDB
+using DefaultConfig = MachineConfig<32,  8,   8,  32,  10>;
+using SmallConfig   = MachineConfig<16,  4,   4,  16,  10>;
+using LargeConfig   = MachineConfig<64, 16,  16,  64,  10>;
+
+// sizes taken from a runtime MachineDesc
+using DynamicConfig = MachineConfig<DYNAMIC_SIZE, DYNAMIC_SIZE, DYNAMIC_SIZE, DYNAMIC_SIZE, DYNAMIC_SIZE>;
+
+// Registry of the configurations that can be picked by name
+#define FOR_EACH_MACHINE_CONFIG(X) \
+    X(DefaultConfig, "default")    \
+    X(SmallConfig, "small")        \
+    X(LargeConfig, "large")
+
+// every templated unit is explicitly instantiated for each of these
+#define FOR_EACH_INSTANTIATED_CONFIG(X) \
+    FOR_EACH_MACHINE_CONFIG(X)          \
+    X(DynamicConfig, "dynamic")
+
+} // namespace jasonfxz
+
+#endif // MACHINE_CONFIG_H
@@ -0,0 +1,155 @@
+/**
+ * @file machine_desc.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief runtime machine description (sizes / latencies) loaded from a text file
+ * @version 0.1
+ * @date 2024-08-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef MACHINE_DESC_H
+#define MACHINE_DESC_H
+
+#include "config/machine_config.h"
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace jasonfxz {
+
+/**
+ * Plain-text format, one `key = value` per line, `#` starts a comment:
+ *
+ *     rob_size = 32
+ *     load_latency = 3
+ *     predictor = tage
+ *
+ * Keys that are not given keep their current value (see Named()).
+ * Print() writes the same format, so the `# machine` part of the
+ * statistics output can be loaded back.
+ */
+struct MachineDesc {
+    // Reservation Stations of rs_size entries: add / camp / logic / shift / lsb / mul / div
+    static constexpr int RS_COUNT = 7;
+
+    int rob_size;      // ROB QUEUE
+    int rs_size;       // Reservation Station (each)
+    int lsb_size;      // Load Store Buffer (load / store queue each)
+    int ins_size;      // Instruction Queue
+    int cdb_width;     // Common Data Bus slots, commit_width of them for the commits
+
+    int add_latency;
+    int camp_latency;
+    int logic_latency;
+    int shift_latency;
+    int load_latency;
+    int store_latency;
+    int add_units{1};         // ALUs of each class, each takes one instruction at a time
+    int camp_units{1};
+    int logic_units{1};
+    int shift_units{1};
+    int mul_units{1};         // RV32M multipliers, pipelined: one instruction enters each cycle
+    int mul_latency{3};
+    int div_units{1};         // RV32M dividers, iterative: one instruction at a time
+    int div_latency{32};      // cycles for a 32-bit dividend, fewer for a smaller one
+    int agu_units{1};         // address generation units, each takes one load / store at a time
+    int agu_latency{1};
+    int fetch_width{1};       // instructions fetched and decoded per cycle
+    int issue_width{1};       // instructions renamed and sent to the RS / LSB / ROB per cycle
+    int commit_width{1};      // instructions committed per cycle
+    int rob_read_ports{2};    // operands issue reads from the ROB per cycle (written back, not committed)
+    int load_ports{1};        // loads started per cycle
+    int outstanding_loads{4}; // loads in flight at a time
+    int store_buffer{0};      // committed stores not written yet (0: a store retires once it is written)
+
+    std::string cdb_policy{"age"};    // age | round_robin, who gets the CDB slots first
+
+    std::string predictor{"bimodal"}; // bimodal | gshare | tournament | tage
+    int predictor_size{32};           // entries of each predictor table, a power of 2
+    int btb_size{64};                 // JALR target buffer entries, a power of 2 (0: none)
+    int ras_size{16};                 // return address stack entries (0: none)
+    int ittage_size{256};             // entries per ITTAGE table, a power of 2 (0: none)
+    int ssit_size{0};                 // store set id table entries, a power of 2 (0: loads never wait)
+    int lfst_size{64};                // last fetched store table entries (store sets), a power of 2
+
+    // L1 instruction cache, bytes (0: none, every fetch is there at once)
+    int icache_size{0};
+    int icache_assoc{2};
+    int icache_line{32};              // bytes, also the block fetch reads at a time
+    std::string icache_policy{"lru"}; // lru | plru | random
+    int icache_hit_latency{1};
+    int icache_miss_latency{20};
+    int fetch_buffer{2};              // blocks
+
+    // L1 data cache, bytes (0: none, loads / stores take load_latency / store_latency)
+    int dcache_size{0};
+    int dcache_assoc{2};
+    int dcache_line{32};              // bytes
+    std::string dcache_policy{"lru"}; // lru | plru | random
+    int dcache_hit_latency{1};
+    int dcache_miss_latency{20};
+    int dcache_mshrs{8};              // misses in flight, a miss to a line already on the way merges into it
+    std::string prefetcher{"none"};   // none | next_line | stride | stream, into the dcache
+    int prefetch_degree{2};           // lines / strides ahead
+    int prefetch_table{64};           // stride: pc table entries, a power of 2
+    int prefetch_streams{4};          // stream: stream buffers
+
+    // L2 shared by both L1s, bytes (0: none)
+    // with an L2 or DRAM behind it, a cache miss takes its hit latency plus the next level's, not its miss latency
+    int l2_size{0};
+    int l2_assoc{8};
+    int l2_line{64};              // bytes
+    std::string l2_policy{"lru"}; // lru | plru | random
+    int l2_hit_latency{8};
+    int l2_miss_latency{100};
+
+    // DRAM behind the last cache (0 banks: none)
+    int dram_banks{0};                 // a power of 2
+    int dram_row_size{2048};           // bytes, a power of 2
+    int dram_row_hit_latency{20};      // the row is open
+    int dram_row_miss_latency{40};     // no row is open: activate
+    int dram_row_conflict_latency{60}; // another row is open: precharge and activate
+    int dram_queue{8};                 // requests in flight, a new one waits for the oldest
+
+    template <typename Config>
+    static MachineDesc From() {
+        MachineDesc desc;
+        desc.rob_size = Config::MAX_ROB_SIZE;
+        desc.rs_size = Config::MAX_RS_SIZE;
+        desc.lsb_size = Config::MAX_LSB_SIZE;
+        desc.ins_size = Config::MAX_INS_SIZE;
+        desc.cdb_width = Config::CDB_WIDTH;
+        desc.add_latency = Config::ADD_LATENCY;
+        desc.camp_latency = Config::CAMP_LATENCY;
+        desc.logic_latency = Config::LOGIC_LATENCY;
+        desc.shift_latency = Config::SHIFT_LATENCY;
+        desc.load_latency = Config::LOAD_LATENCY;
+        desc.store_latency = Config::STORE_LATENCY;
+        return desc;
+    }
+
+    // MachineDesc::From<Config>() for a name in FOR_EACH_MACHINE_CONFIG, throw if unknown
+    static MachineDesc Named(const std::string &name);
+
+    // true if the buffer sizes fit Config (DYNAMIC_SIZE fits everything)
+    template <typename Config>
+    bool FitsIn() const {
+        auto fits = [](int size, int max_size) { return max_size == DYNAMIC_SIZE || size == max_size; };
+        return fits(rob_size, Config::MAX_ROB_SIZE) && fits(rs_size, Config::MAX_RS_SIZE)
+               && fits(lsb_size, Config::MAX_LSB_SIZE) && fits(ins_size, Config::MAX_INS_SIZE)
+               && fits(cdb_width, Config::CDB_WIDTH);
+    }
+
+    // throw std::runtime_error on unknown key / bad value
+    void Load(std::istream &is);
+    void Set(const std::string &key, int value);
+    void Set(const std::string &key, const std::string &value);
+    void Validate() const;
+    void Print(std::ostream &os) const;
+};
+
+} // namespace jasonfxz
+
+#endif // MACHINE_DESC_H
@@ -25,6 +25,7 @@ using WordType = uint32_t; // 32-bit word
 using HalfType = uint16_t; // 16-bit half word
 using ByteType = uint8_t;  // 8-bit byte
 using ReturnType = uint8_t; // return type
+using SeqType = int64_t;    // program order of an issued instruction, never reused
 
 enum class OpClass {
     OTHER,
@@ -88,6 +89,16 @@ enum OpType {
     OR,    // OR                                 0b011'0011    R-type
     AND,   // AND                                0b011'0011    R-type
 
+    // RV32M  MULTIPLY / DIVIDE, ARITHR too
+    MUL,   // Multiply, low 32 bits              0b011'0011    R-type
+    MULH,  // Multiply High (signed)             0b011'0011    R-type
+    MULHSU,// Multiply High (signed x unsigned)  0b011'0011    R-type
+    MULHU, // Multiply High (unsigned)           0b011'0011    R-type
+    DIV,   // Divide                             0b011'0011    R-type
+    DIVU,  // Divide Unsigned                    0b011'0011    R-type
+    REM,   // Remainder                          0b011'0011    R-type
+    REMU,  // Remainder Unsigned                 0b011'0011    R-type
+
 
 
 };
@@ -131,11 +142,19 @@ enum reName {
 
 std::string OpcodeToStr(OpType opt);
 
+// Speculative predictor state right before an instruction was fetched, so that a
+// branch can put it back when it resolves as mispredicted, and a replayed load too
+struct PredictorCheckpoint {
+    uint64_t history{0}; // Predictor
+    uint64_t path{0};    // TargetPredictor
+    int ras_top{0}, ras_count{0};
+};
+
 // Instruction Type
 struct InsType {
     friend class Decoder;
-    friend class InstructionUnit;
-    friend class Simulator;
+    template <typename Config> friend class InstructionUnit;
+    template <typename Config> friend class Simulator;
 
   private:
     int opcode;
@@ -146,6 +165,14 @@ struct InsType {
     OpClass opc;
     int rd{-1}, rs1{-1}, rs2{-1}, imm;
     AddrType ins_addr;
+    // set by TargetPredictor at fetch
+    bool ras_push{false}, ras_pop{false};
+    bool target_predicted{false}, target_ittage{false}; // target_ittage: by ITTAGE, not the BTB
+    AddrType target{0}; // predicted target of a JALR
+    // set by InstructionUnit at fetch
+    PredictorCheckpoint checkpoint;
+    int fetch_clock{0}; // BRANCH only
+    SeqType seq{-1}; // set at issue
     friend std::ostream &operator<<(std::ostream &os, const InsType &ins) {
         os << "IR: " << std::setw(8) << std::setfill('0') << std::hex << ins.ir
            << std::dec << std::setfill(' ')
@@ -165,6 +192,7 @@ struct InsType {
         os << std::dec;
         switch (this->opt) {
         case ADD: case SUB: case AND: case OR: case XOR: case SLL: case SRL: case SRA: case SLT: case SLTU:
+        case MUL: case MULH: case MULHSU: case MULHU: case DIV: case DIVU: case REM: case REMU:
             os << OpcodeToStr(this->opt) << " x" << this->rd << ", x" << this->rs1 << ", x" << this->rs2 << std::endl; break;
         case ADDI: case ANDI: case ORI: case XORI: case SLTI: case SLTIU:
             os << OpcodeToStr(this->opt) << " x" << this->rd << ", x" << this->rs1 << ", " << this->imm << std::endl; break;
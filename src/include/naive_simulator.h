@@ -81,6 +81,16 @@ class NSimulator {
     void ExeSLT(int rd, int rs1, int rs2); // rd = rs1 < rs2 ? 1 : 0 (signed)
     void ExeSLTU(int rd, int rs1, int rs2); // rd = rs1 < rs2 ? 1 : 0 (unsigned)
 
+    // RV32M, division by zero and overflow as the spec says
+    void ExeMUL(int rd, int rs1, int rs2);    // rd = (rs1 * rs2)[31:0]
+    void ExeMULH(int rd, int rs1, int rs2);   // rd = (rs1 * rs2)[63:32] (signed x signed)
+    void ExeMULHSU(int rd, int rs1, int rs2); // rd = (rs1 * rs2)[63:32] (signed x unsigned)
+    void ExeMULHU(int rd, int rs1, int rs2);  // rd = (rs1 * rs2)[63:32] (unsigned x unsigned)
+    void ExeDIV(int rd, int rs1, int rs2);    // rd = rs1 / rs2 (signed)
+    void ExeDIVU(int rd, int rs1, int rs2);   // rd = rs1 / rs2 (unsigned)
+    void ExeREM(int rd, int rs1, int rs2);    // rd = rs1 % rs2 (signed)
+    void ExeREMU(int rd, int rs1, int rs2);   // rd = rs1 % rs2 (unsigned)
+
     void ExeADDI(int rd, int rs1, int imm); // rd = rs1 + imm
     void ExeANDI(int rd, int rs1, int imm); // rd = rs1 & imm
     void ExeORI(int rd, int rs1, int imm);  // rd = rs1 | imm
@@ -121,6 +131,7 @@ class NSimulator {
     void Init(std::istream &is);
     bool Step(DebugRecord &record);
     ReturnType Run();
+    AddrType Pc() const { return pc; } // after Step(): the next instruction
     void PrintReg();
     void PrintRegHelp();
     void PrintMem(AddrType addr, int len);
@@ -12,108 +12,235 @@
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
+#include <deque>
 #include <istream>
+#include <memory>
 #include <ostream>
+#include <string>
 #include <utility>
+#include <vector>
+#include "config/machine_config.h"
+#include "config/machine_desc.h"
 #include "config/types.h"
+#include "units/address_generation_unit.h"
 #include "units/arithmetic_logic_unit.h"
 #include "units/base_unit.h"
+#include "units/cache.h"
+#include "units/dram.h"
 #include "units/instruction_unit.h"
 #include "units/memory_unit.h"
+#include "units/prefetcher.h"
 #include "units/register_file.h"
 #include "units/reservation_station.h"
 #include "units/load_store_buffer.h"
 #include "units/reorder_buffer.h"
+#include "units/target_predictor.h"
 #include "utils/utils.h"
 
 namespace jasonfxz {
 
 using std::pair;
 
+enum class SquashCause {
+    Branch, // the instruction before `from` is a branch that went the other way
+    Jalr,   // the instruction before `from` is a JALR that committed with another target
+    Replay, // `from` is a load that read its data too early, and is fetched again
+};
+
+// Set by the unit that finds a misprediction (State::set_squash): in the next cycle
+// every unit drops what belongs to instructions issued from `from` on, and the ROB
+// puts the renaming and the predictors back.
+struct Squash {
+    bool valid{false};
+    SeqType from{-1};
+    SquashCause cause{SquashCause::Branch};
+    bool Squashed(SeqType seq) const { return seq >= from; }
+};
 
 class State {
   public:
     // For Debug
     bool enable_debug{false};
     bool have_commit{false};
-    int commit_pc{0};
-    int commit_ir{0};
+    bool record_commits{false};       // for Step(): fill `commits`
+    std::vector<DebugRecord> commits; // every commit of the cycle, with the registers right after it
 
     int clock; // clock cycle
 
     bool halt{false}; // halt flag (terminate the simulation)
     bool wait{false}; // wait flag (Instruction fetch STOP)
-    bool clear{false}; // clear flag (Clear All because of prediction failed)
+    Squash squash;     // throw away the instructions on a wrong path
 
     // pc & ir
     AddrType pc;
     WordType ir;
+    bool ir_valid{true}; // false: still on its way from the icache
 
     // Ins
-    bool ins_queue_full{false};
-    pair<bool, InsType> ins{false, InsType()}; // Decoded by decoder in last cycle
+    int ins_queue_free{0};
+    std::vector<InsType> ins; // Decoded by decoder in last cycle, in program order
 
     // Register file
     RegisterFile regfile;
 
-    /// ALU
-    pair<bool, AluInter> alu_add_inter{false, AluInter()};
-    bool alu_add_busy{false};
-    pair<bool, AluInter> alu_camp_inter{false, AluInter()};
-    bool alu_camp_busy{false};
-    pair<bool, AluInter> alu_logic_inter{false, AluInter()};
-    bool alu_logic_busy{false};
-    pair<bool, AluInter> alu_shift_inter{false, AluInter()};
-    bool alu_shift_busy{false};
-
-    // RS
-    pair<bool, RsInter> rs_inter{false, RsInter()};
-    bool rs_alu_add_full{false};
-    bool rs_alu_camp_full{false};
-    bool rs_alu_logic_full{false};
-    bool rs_alu_shift_full{false};
-    bool rs_lsb_full{false};
-
-    // LSB
-    pair<bool, LsbInter> lsb_load_inter{false, LsbInter()};
-    bool lsb_load_full{false};
-    pair<bool, LsbInter> lsb_store_inter{false, LsbInter()};
-    bool lsb_store_full{false};
+    /// ALU: dispatched in the last cycle, at most one per free unit; units that can take one
+    std::vector<AluInter> alu_add_inters;
+    int alu_add_free{0};
+    std::vector<AluInter> alu_camp_inters;
+    int alu_camp_free{0};
+    std::vector<AluInter> alu_logic_inters;
+    int alu_logic_free{0};
+    std::vector<AluInter> alu_shift_inters;
+    int alu_shift_free{0};
+    std::vector<AluInter> alu_mul_inters;
+    int alu_mul_free{0};
+    std::vector<AluInter> alu_div_inters;
+    int alu_div_free{0};
+
+    /// AGU: dispatched from the LSB RS in the last cycle; AGUs that can take one
+    std::vector<AluInter> agu_inters;
+    int agu_free{0};
+    // addresses made in the last cycle, for the LSB
+    std::vector<AddrInter> lsb_addrs;
+
+    // what was issued in the last cycle goes to the units below, in program order
+
+    // RS, free entries
+    std::vector<RsInter> rs_inters;
+    int rs_alu_add_free{0};
+    int rs_alu_camp_free{0};
+    int rs_alu_logic_free{0};
+    int rs_alu_shift_free{0};
+    int rs_alu_mul_free{0};
+    int rs_alu_div_free{0};
+    int rs_lsb_free{0};
+
+    // LSB, free entries
+    std::vector<LsbInter> lsb_load_inters;
+    int lsb_load_free{0};
+    std::vector<LsbInter> lsb_store_inters;
+    int lsb_store_free{0};
+    int store_buffer_free{0}; // committed stores there is still room for
 
     // ROB
-    pair<bool, RobInter> rob_inter{false, RobInter()};
-    bool rob_full{false};
+    std::vector<RobInter> rob_inters;
+    int rob_free{0};
     int rob_tail_pos{0};
-
-    int query_rob_id1{-1}, query_rob_id2{-1};
-    // pos, data
-    pair<int, int> query_rob_id1_data{-1, 0}, query_rob_id2_data{-1, 0};
+    // of every rob_pos: the data, if it has been written back and not committed, for Issue to read
+    std::vector<pair<bool, int>> rob_data;
 
   public:
-    void clear_state();
+    // fetch goes on from pc; of two in the same cycle the older one wins
+    void set_squash(SeqType from, AddrType pc, SquashCause cause);
+    // drop what was passed on in the last cycle by the instructions `squash` throws away
+    void squash_state();
+    // back to a fresh state, keeping what the vectors have allocated
+    void reset();
 };
 
 
 
-class Simulator {
+struct SimStats {
+    long long cycles{0};
+    long long instructions{0}; // committed
+    long long branches{0};     // conditional branches seen by the predictor
+    long long branch_hits{0};
+    long long mispredicts{0};       // branches squashed at execute (a JALR squashes at commit)
+    long long mispredict_cycles{0}; // from fetching them to fetching their right target
+    double Ipc() const { return cycles == 0 ? 0.0 : (double)instructions / cycles; }
+    double BranchAccuracy() const { return branches == 0 ? 100.0 : 100.0 * branch_hits / branches; }
+    // mispredictions per 1000 committed instructions
+    double BranchMpki() const { return instructions == 0 ? 0.0 : 1000.0 * (branches - branch_hits) / instructions; }
+    double MispredictPenalty() const { return mispredicts == 0 ? 0.0 : (double)mispredict_cycles / mispredicts; }
+};
 
+// What the outside world needs from a Simulator<Config>,
+// so that the machine configuration can be picked at runtime.
+class BaseSimulator {
   public:
-    Simulator();
-    ~Simulator();
-    void Init(std::istream &is);
-    ReturnType Run();
-    bool Step(DebugRecord &record);
+    // A full copy of the machine taken between two cycles.
+    // It can only be loaded back into the simulator it was taken from,
+    // because the units still point to that simulator's bus / memory / predictor.
+    struct Snapshot {
+        virtual ~Snapshot() = default;
+        virtual int Clock() const = 0;
+    };
+
+    virtual ~BaseSimulator() = default;
+    virtual void Init(std::istream &is) = 0;
+    virtual ReturnType Run() = 0;
+    virtual bool Step(DebugRecord &record) = 0;
+    virtual std::unique_ptr<Snapshot> SaveSnapshot() const = 0;
+    virtual void LoadSnapshot(const Snapshot &snap) = 0;
+    virtual int Clock() const = 0;
+    virtual SimStats Stats() const = 0;
+    // the machine description, then Stats(), as `key = value`
+    virtual void PrintStats(std::ostream &os) const = 0;
+
+    bool enable_debug{false};
+    int debug_from_clock{-1}; // Step() turns on enable_debug once this clock is reached (-1: never)
+    int max_clock{-1};        // Run() throws std::runtime_error once this clock is reached (-1: never)
+};
+
+template <typename Config>
+class Simulator : public BaseSimulator {
+
+  public:
+    struct Snapshot : public BaseSimulator::Snapshot {
+        explicit Snapshot(const Simulator &sim);
+        int Clock() const override { return next_state.clock; }
+        State cur_state, next_state;
+        CdBus<Config> cd_bus;
+        std::unique_ptr<Predictor> predictor;
+        TargetPredictor target_predictor;
+        Cache icache, dcache, l2;
+        Dram dram;
+        std::unique_ptr<Prefetcher> prefetcher;
+        Memory mem;
+        LoadStoreBuffer<Config> lsb;
+        ReservationStation<Config> rs;
+        ArithmeticLogicUnit<Config> alu;
+        AddressGenerationUnit<Config> agu;
+        InstructionUnit<Config> iu;
+        ReorderBuffer<Config> rob;
+        std::deque<DebugRecord> pending;
+    };
+
+    explicit Simulator(const MachineDesc &desc = MachineDesc::From<Config>());
+    ~Simulator() override;
+    Simulator(const Simulator &) = delete;
+    Simulator &operator=(const Simulator &) = delete;
+    void Init(std::istream &is) override;
+    ReturnType Run() override;
+    bool Step(DebugRecord &record) override;
+    std::unique_ptr<BaseSimulator::Snapshot> SaveSnapshot() const override;
+    void LoadSnapshot(const BaseSimulator::Snapshot &snap) override;
+    int Clock() const override { return next_state->clock; }
+    SimStats Stats() const override;
+    void PrintStats(std::ostream &os) const override;
   private:
     void Flush();
     void Execute();
   private:
+    MachineDesc desc;
     State *cur_state, *next_state;
-    CdBus *cd_bus;
+    CdBus<Config> *cd_bus;
     Predictor *predictor;
-    BaseUnit *units[5];
+    TargetPredictor *target_predictor;
+    Cache *icache, *dcache, *l2; // both L1s go to the l2, if there is one
+    Dram *dram;
+    Prefetcher *prefetcher; // of the dcache, nullptr: none
+    BaseUnit *units[6];
+    // the same units as above, which Run() shuffles
+    LoadStoreBuffer<Config> *lsb;
+    ReservationStation<Config> *rs;
+    ArithmeticLogicUnit<Config> *alu;
+    AddressGenerationUnit<Config> *agu;
+    InstructionUnit<Config> *iu;
+    ReorderBuffer<Config> *rob;
+    std::deque<DebugRecord> pending; // committed in the last cycle, not returned by Step() yet
   public:
     Memory *mem;
-    bool enable_debug{false};
     void PrintReg(std::ostream &os, RegisterFile *regfile);
     void PrintRegFile(std::ostream &os, RegisterFile *regfile);
     void PrintRegHelp(std::ostream &os);
@@ -121,6 +248,11 @@ class Simulator {
     void PrintCdBus(std::ostream &os);
 };
 
+// Validate desc, then build the first Simulator<Config> in FOR_EACH_MACHINE_CONFIG
+// whose sizes match, falling back to Simulator<DynamicConfig>
+std::unique_ptr<BaseSimulator> MakeSimulator(const MachineDesc &desc);
+std::vector<std::string> MachineConfigNames();
+
 
 } // namespace jasonfxz
 
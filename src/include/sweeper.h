@@ -0,0 +1,99 @@
+/**
+ * @file sweeper.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief design-space sweep of machine parameters over a set of programs
+ * @version 0.1
+ * @date 2024-08-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef SWEEPER_H
+#define SWEEPER_H
+
+#include "config/machine_desc.h"
+#include "simulator.h"
+#include <functional>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace jasonfxz {
+
+struct SweepPoint {
+    std::vector<std::string> values; // one per SweepSpec::params
+    MachineDesc desc;
+};
+
+/**
+ * Same `key = value` format as MachineDesc, `#` starts a comment:
+ *
+ *     base = default                  # preset every point starts from
+ *     program = testcases/qsort.data testcases/tak.data
+ *     rob_size = 16 32 64             # any MachineDesc key, a list of values
+ *     load_latency = 1..4             # or an inclusive range
+ *     predictor = gshare tage
+ *     sample = lhs 20                 # grid | random N | lhs N (Latin hypercube)
+ *     seed = 1
+ *     threads = 0                     # 0: one per hardware thread
+ *     max_cycles = 1000000000         # a run that has not halted by then is recorded as failed
+ *     output = sweep.tsv
+ */
+struct SweepSpec {
+    std::string base{"default"};
+    std::vector<std::string> programs;
+    std::vector<std::pair<std::string, std::vector<std::string>>> params; // in file order
+    std::string sample{"grid"};
+    int samples{0};
+    unsigned seed{1};
+    int threads{0};
+    int max_cycles{1000000000};
+    std::string output{"sweep.tsv"};
+
+    // throw std::runtime_error on unknown key / bad value
+    void Load(std::istream &is);
+    // the points picked by `sample`, the same ones for the same seed
+    std::vector<SweepPoint> Points() const;
+};
+
+// run job(0) ... job(count - 1) on `threads` threads (0: one per hardware thread);
+// the first exception a job throws is thrown again once all threads are done
+void ParallelFor(int threads, size_t count, const std::function<void(size_t)> &job);
+
+/**
+ * Every (point, program) pair is run on its own Simulator by a pool of threads.
+ * Each result is appended to spec.output as soon as it is done, and the pairs
+ * already there are skipped, so an interrupted sweep is resumed by running it again.
+ * A run that throws (or does not halt within max_cycles) is written as a `failed`
+ * row, which is not run again, and its point is left out of the Pareto front.
+ */
+class Sweeper {
+  public:
+    explicit Sweeper(const SweepSpec &spec);
+    // run what is missing, then print the Pareto front of IPC against buffer entries
+    void Run(std::ostream &os);
+
+  private:
+    using Point = SweepPoint;
+    struct Result {
+        SimStats stats;
+        int ret;
+        std::string error; // empty: the run halted
+    };
+
+    std::string Header() const;
+    std::string Key(const Point &point, const std::string &program) const;
+    void LoadResults();
+    void PrintParetoFront(std::ostream &os, const std::vector<Point> &points) const;
+
+    SweepSpec spec;
+    std::map<std::string, Result> results; // by Key()
+};
+
+} // namespace jasonfxz
+
+#endif // SWEEPER_H
@@ -0,0 +1,65 @@
+/**
+ * @file address_generation_unit.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief address generation units between the LSB reservation station and the LSB
+ * @version 0.1
+ * @date 2024-08-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef ADDRESS_GENERATION_UNIT_H
+#define ADDRESS_GENERATION_UNIT_H
+
+#include "base_unit.h"
+#include "circuits/bus.h"
+#include "config/machine_desc.h"
+#include "config/types.h"
+#include "units/arithmetic_logic_unit.h"
+#include <ostream>
+#include <vector>
+
+namespace jasonfxz {
+
+// the address of a load / store, AGU ==> LSB
+struct AddrInter {
+    int rob_pos;
+    SeqType seq;
+    AddrType addr;
+};
+
+// LOAD: addr = lhs (rs1) + rhs (imm)
+// STORE: addr = lhs (rs1) + imm, rhs (rs2) is the data
+class AguCalc : public BaseCalc {
+  public:
+    bool Calc() override;
+    bool IsStore() const;
+};
+
+/**
+ * agu_units AGUs, each takes one load / store at a time from the LSB RS, oldest
+ * first, for agu_latency cycles. The address goes to the LSB on a path of its
+ * own (State::lsb_addrs), not on the CDB; only the data of a store, which the
+ * ROB waits for, is written back on the CDB, and the AGU keeps it until it gets a slot.
+ */
+template <typename Config>
+class AddressGenerationUnit : public BaseUnit {
+  public:
+    AddressGenerationUnit(CdBus<Config> *cd_bus, const MachineDesc &desc);
+    void Flush(State *cur_state) override;
+    void Execute(State *cur_state, State *next_state) override;
+    // agu<i>_busy / _utilization of every AGU, agu_addresses, as `key = value`
+    void PrintStats(std::ostream &os) const;
+
+  private:
+    std::vector<AguCalc> calcs;
+    std::vector<AluInter> held; // sent to an AGU that was still waiting for the bus
+    long long cycles{0}, addresses{0};
+
+    CdBus<Config> *cd_bus;
+};
+
+} // namespace jasonfxz
+
+#endif // ADDRESS_GENERATION_UNIT_H
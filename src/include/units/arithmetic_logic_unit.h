@@ -16,6 +16,11 @@
 #include "base_unit.h"
 #include "config/types.h"
 #include "circuits/bus.h"
+#include "config/machine_desc.h"
+#include <algorithm>
+#include <deque>
+#include <ostream>
+#include <vector>
 
 namespace jasonfxz {
 
@@ -23,7 +28,12 @@ namespace jasonfxz {
 struct AluInter {
     int lhs, rhs;
     int rob_pos;
+    SeqType seq;
     OpType opt;
+    // BRANCH: resolved by CampCalc
+    bool pred{false}; // predicted taken
+    AddrType ins_addr{0};
+    int imm{0};
 };
 
 
@@ -33,59 +43,167 @@ class BaseCalc {
     int latency{1};
     int cur{0};
     int res{0};
+    long long busy_cycles{0}; // cycles with an instruction in it
+    int ticket{-1};           // its result has asked for the bus in this cycle (Bus::Request)
+    bool stalled{false};      // its result lost the bus, it asks again
   public:
-    virtual void Calc() = 0;
-    virtual void Flush(State *cur_state) = 0;
+    virtual bool Calc() = 0; // true when the result is ready in this cycle
+    // empty, Start() may be called
+    bool CanStart() const { return cur == 0; }
+    void Start(const AluInter &inter) {
+        cur = 1;
+        _ = inter;
+    }
+    // can not take another one in this cycle
+    bool Busy() const { return 0 < cur && cur < latency; }
+    // once a cycle, for the statistics
+    void Tick() {
+        if (cur != 0) ++busy_cycles;
+    }
+    // clear() if the instruction in it is squashed
+    template <typename Pred>
+    void Drop(Pred squashed) {
+        if (cur != 0 && squashed(_.seq)) clear();
+    }
+    // the bus has decided on its result: it is done, or it keeps it for the next cycle
+    void Written(bool granted) {
+        if (granted) cur = 0;
+        stalled = !granted;
+        ticket = -1;
+    }
     void clear() {
         cur = 0;
+        ticket = -1;
+        stalled = false;
     }
 };
 
 // ADD / SUB
 class AddCalc : public BaseCalc {
   public:
-    void Calc() override;
-    void Flush(State *cur_state) override;
+    bool Calc() override;
 };
 
 // SLT / SLTU
 class CampCalc : public BaseCalc {
   public:
-    void Calc() override;
-    void Flush(State *cur_state) override;
-
+    bool Calc() override;
 };
 
 // XOR / OR / AND
 class LogicCalc : public BaseCalc {
   public:
-    void Calc() override;
-    void Flush(State *cur_state) override;
-
+    bool Calc() override;
 };
 
 // SLL / SRL / SRA
 class ShiftCalc : public BaseCalc {
   public:
-    void Calc() override;
-    void Flush(State *cur_state) override;
+    bool Calc() override;
+};
 
+// MUL / MULH / MULHSU / MULHU, pipelined: a new instruction may start every cycle,
+// each takes latency cycles. Calc() leaves the one that is done in `_` / res; while
+// it waits for the bus, the ones behind it wait too.
+// The members below hide BaseCalc's, ArithmeticLogicUnit only calls them on a MulCalc.
+class MulCalc : public BaseCalc {
+  public:
+    bool Calc() override;
+    bool CanStart() const { return stages.empty() || stages.back().cur > 1; }
+    void Start(const AluInter &inter) { stages.push_back({inter, 1}); }
+    bool Busy() const { return false; }
+    void Tick() {
+        if (!stages.empty()) ++busy_cycles;
+        in_flight += stages.size();
+    }
+    template <typename Pred>
+    void Drop(Pred squashed) {
+        // the RS starts the oldest *ready* one, so a younger one may be ahead of an
+        // older one; the request of the front one goes with it
+        if (!stages.empty() && squashed(stages.front().inter.seq)) {
+            ticket = -1;
+            stalled = false;
+        }
+        stages.erase(std::remove_if(stages.begin(), stages.end(),
+                                    [&](const Stage &stage) { return squashed(stage.inter.seq); }),
+                     stages.end());
+        if (stages.empty()) clear();
+    }
+    void Written(bool granted);
+    void clear() {
+        stages.clear();
+        ticket = -1;
+        stalled = false;
+    }
+
+    long long in_flight{0}; // summed over the cycles
+
+  private:
+    struct Stage {
+        AluInter inter;
+        int cur;
+    };
+    std::deque<Stage> stages; // in the order they started, not program order
 };
 
+// DIV / DIVU / REM / REMU, iterative: one instruction at a time, which takes up to
+// max_latency cycles, fewer for a dividend with fewer significant bits
+// (early out), one for a division by zero
+class DivCalc : public BaseCalc {
+  public:
+    int max_latency{32};
 
+    bool Calc() override;
+    void Start(const AluInter &inter);
+};
 
+
+// hands what the RS dispatched, after what was held back before, to the units that can start
+// one; the rest is held back. How many more the RS may send in this cycle
+template <typename Calc>
+int Accept(std::vector<Calc> &calcs, std::vector<AluInter> &held, const std::vector<AluInter> &inters) {
+    held.insert(held.end(), inters.begin(), inters.end());
+    auto inter = held.begin();
+    int free = 0;
+    for (auto &calc : calcs) {
+        if (calc.CanStart() && inter != held.end()) calc.Start(*inter++);
+        calc.Tick();
+        free += !calc.Busy();
+    }
+    held.erase(held.begin(), inter);
+    return std::max(0, free - (int)held.size());
+}
+
+// <class>_units of each class; the RS sends one instruction at a time to every unit that is free
+// (to a multiplier in every cycle). A result that loses the bus stays in its unit
+template <typename Config>
 class ArithmeticLogicUnit : public BaseUnit {
   private:
-    AddCalc addCalc;
-    CampCalc campCalc;
-    LogicCalc logicCalc;
-    ShiftCalc shiftCalc;
-
-    CdBus *cd_bus;
+    std::vector<AddCalc> add_calcs;
+    std::vector<CampCalc> camp_calcs;
+    std::vector<LogicCalc> logic_calcs;
+    std::vector<ShiftCalc> shift_calcs;
+    std::vector<MulCalc> mul_calcs;
+    std::vector<DivCalc> div_calcs;
+    // sent by the RS to a unit that was still waiting for the bus, each class
+    std::vector<AluInter> add_held, camp_held, logic_held, shift_held, mul_held, div_held;
+    long long cycles{0};
+
+    CdBus<Config> *cd_bus;
   public:
-    explicit ArithmeticLogicUnit(CdBus *cd_bus);
+    ArithmeticLogicUnit(CdBus<Config> *cd_bus, const MachineDesc &desc);
     void Flush(State *cur_state) override;
     void Execute(State *cur_state, State *next_state) override;
+    // alu_<class><i>_busy / _utilization of every unit (cycles with an instruction in it, or its result),
+    // and alu_mul<i>_occupancy (instructions in its pipeline, on average), as `key = value`
+    void PrintStats(std::ostream &os) const;
+
+  private:
+    // the results that asked for the bus in the last cycle leave their unit if they got it
+    template <typename Calc>
+    void Retire(std::vector<Calc> &calcs);
+    // a mispredicted branch redirects fetch now and squashes the younger instructions next cycle
+    void Resolve(const AluInter &branch, bool taken, State *next_state);
 };
 
 } // namespace jasonfxz
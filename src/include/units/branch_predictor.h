@@ -0,0 +1,162 @@
+/**
+ * @file branch_predictor.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief conditional branch predictors (bimodal / gshare / tournament / TAGE)
+ * @version 0.1
+ * @date 2024-08-09
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include "config/types.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace jasonfxz {
+
+struct MachineDesc;
+
+// xor of the `bits`-wide slices of the newest `len` bits of history
+inline uint32_t Fold(uint64_t history, int len, int bits) {
+    if (bits == 0) return 0;
+    if (len < 64) history &= (1ULL << len) - 1;
+    uint32_t res = 0;
+    for (; history; history >>= bits) {
+        res ^= history & ((1U << bits) - 1);
+    }
+    return res;
+}
+
+/**
+ * GetPrediction() is called at fetch and shifts the predicted direction into the
+ * speculative global history; GetFeedBack() is called at commit and shifts the real
+ * one into the committed history. A mispredicted branch is found at execute, and
+ * Restore() puts back the history it was predicted with, plus its real direction.
+ * A JALR squashes everything younger than itself when it commits, so there
+ * Recover() only has to copy the committed history back.
+ * The committed history at commit is also the one the branch was predicted with,
+ * so the tables are trained with the same indices they were read with.
+ */
+class Predictor {
+  public:
+    virtual ~Predictor() = default;
+    // for Simulator snapshots: the units keep pointing to the same object
+    virtual std::unique_ptr<Predictor> Clone() const = 0;
+    virtual void Assign(const Predictor &other) = 0;
+
+    bool GetPrediction(AddrType pc);
+    void GetFeedBack(AddrType pc, bool real, bool pred);
+    void Recover() { spec_history = commit_history; }
+    void Save(PredictorCheckpoint &checkpoint) const { checkpoint.history = spec_history; }
+    void Restore(const PredictorCheckpoint &checkpoint, bool taken) { spec_history = checkpoint.history << 1 | taken; }
+    // back to right before the instruction the checkpoint was taken at
+    void Restore(const PredictorCheckpoint &checkpoint) { spec_history = checkpoint.history; }
+
+    int Total() const { return count_tot; }
+    int Hits() const { return count_suc; }
+    // counters of the implementation, as `predictor.xxx = value`
+    virtual void PrintStats(std::ostream &) const {}
+
+    // lookup / training with an explicit history, without touching the ones above
+    virtual bool Predict(AddrType pc, uint64_t history) const = 0;
+    virtual void Update(AddrType pc, uint64_t history, bool taken) = 0;
+
+  private:
+    uint64_t spec_history{0}, commit_history{0}; // newest branch in bit 0
+    int count_tot{0}, count_suc{0};
+};
+
+template <typename Derived>
+class PredictorBase : public Predictor {
+  public:
+    std::unique_ptr<Predictor> Clone() const override {
+        return std::make_unique<Derived>(static_cast<const Derived &>(*this));
+    }
+    void Assign(const Predictor &other) override {
+        static_cast<Derived &>(*this) = static_cast<const Derived &>(other);
+    }
+};
+
+// 2-bit counters indexed by pc
+class BimodalPredictor : public PredictorBase<BimodalPredictor> {
+  public:
+    explicit BimodalPredictor(int size) : table(size, 1) {}
+    bool Predict(AddrType pc, uint64_t history) const override;
+    void Update(AddrType pc, uint64_t history, bool taken) override;
+  private:
+    std::vector<uint8_t> table;
+};
+
+// 2-bit counters indexed by pc xor global history (log2(size) bits of it)
+class GsharePredictor : public PredictorBase<GsharePredictor> {
+  public:
+    explicit GsharePredictor(int size) : table(size, 1) {}
+    bool Predict(AddrType pc, uint64_t history) const override;
+    void Update(AddrType pc, uint64_t history, bool taken) override;
+  private:
+    std::vector<uint8_t> table;
+};
+
+// bimodal and gshare, with a per-pc chooser trained when they disagree
+class TournamentPredictor : public PredictorBase<TournamentPredictor> {
+  public:
+    explicit TournamentPredictor(int size) : bimodal(size), gshare(size), chooser(size, 1) {}
+    void PrintStats(std::ostream &os) const override;
+    bool Predict(AddrType pc, uint64_t history) const override;
+    void Update(AddrType pc, uint64_t history, bool taken) override;
+  private:
+    BimodalPredictor bimodal;
+    GsharePredictor gshare;
+    std::vector<uint8_t> chooser; // >= 2: gshare
+    long long chose_gshare{0}, bimodal_hits{0}, gshare_hits{0};
+};
+
+// bimodal base plus tagged tables over geometric history lengths
+class TagePredictor : public PredictorBase<TagePredictor> {
+  public:
+    static constexpr int TABLES = 4;
+    static constexpr int TAG_BITS = 9;
+    static constexpr std::array<int, TABLES> HISTORY_LENGTH{4, 10, 25, 64};
+    static constexpr int USEFUL_RESET_PERIOD = 1 << 18; // branches between halving every u
+
+    explicit TagePredictor(int size);
+    void PrintStats(std::ostream &os) const override;
+    bool Predict(AddrType pc, uint64_t history) const override;
+    void Update(AddrType pc, uint64_t history, bool taken) override;
+  private:
+    struct Entry {
+        bool valid{false}; // allocated once: tag 0 must not hit an empty entry
+        uint16_t tag{0};
+        int8_t ctr{0}; // 3-bit signed, >= 0: taken
+        uint8_t u{0};  // 2-bit useful
+    };
+    struct Lookup {
+        int provider{-1}, alt{-1}; // table, -1: base
+        int index[TABLES];
+        uint16_t tag[TABLES];
+    };
+    Lookup Find(AddrType pc, uint64_t history) const;
+    bool PredOf(const Lookup &look, int table, AddrType pc) const;
+
+    BimodalPredictor base;
+    int index_bits;
+    std::vector<Entry> tables[TABLES];
+    int tick{0};
+    long long provider_count[TABLES + 1]{}; // [0]: base
+};
+
+// throw std::runtime_error if desc.predictor is unknown
+std::unique_ptr<Predictor> MakePredictor(const MachineDesc &desc);
+std::vector<std::string> PredictorNames();
+
+} // namespace jasonfxz
+
+#endif // BRANCH_PREDICTOR_H
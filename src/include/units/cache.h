@@ -0,0 +1,129 @@
+/**
+ * @file cache.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief set-associative cache timing model (the data itself stays in Memory)
+ * @version 0.1
+ * @date 2024-08-13
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "config/types.h"
+#include "units/prefetcher.h"
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace jasonfxz {
+
+enum class ReplacePolicy {
+    Lru,
+    Plru,   // tree pseudo-LRU
+    Random,
+};
+
+// "lru" | "plru" | "random", throw std::runtime_error if unknown
+ReplacePolicy ReplacePolicyFrom(const std::string &name);
+
+// what is behind a cache
+class MemoryLevel {
+  public:
+    virtual ~MemoryLevel() = default;
+    // cycles until the data is there, for a request made at cycle `now`
+    // pc: of the instruction, for the per-pc statistics
+    virtual int Access(AddrType addr, bool write, AddrType pc, long long now) = 0;
+};
+
+/**
+ * Write-back, write-allocate. Only the tags are kept: Access() tells how long
+ * an access takes and updates the lines, the data is read from and written to
+ * Memory as before. A miss takes miss_latency, or with a `next` level,
+ * hit_latency plus what the next level takes for the line. A dirty line that
+ * is evicted is written to the next level, but a write buffer takes that off
+ * the critical path, so it costs the access nothing.
+ * Random replacement draws from its own xorshift, so a run can be repeated and
+ * a Simulator snapshot copies it.
+ * A miss holds an MSHR until its line is there. Another access to that line in
+ * the meantime merges into it and waits for the same fill; other lines hit as
+ * usual (hit under miss). With all `mshrs` taken, Full() tells the caller to try
+ * a miss again later. mshrs 0: no limit.
+ * An attached Prefetcher sees every access and fills lines ahead of them, each
+ * with an MSHR of its own; a prefetch with none free is dropped. A prefetched
+ * line is useful once a demand access hits it, late if it is still on the way
+ * then, useless if it is evicted before. A miss to a line a prefetch evicted
+ * counts as pollution; each way remembers the last line a prefetch into it evicted.
+ * size 0: no cache.
+ */
+class Cache : public MemoryLevel {
+  public:
+    Cache(int size, int assoc, int line, ReplacePolicy policy, int hit_latency, int miss_latency,
+          MemoryLevel *next = nullptr, int mshrs = 0);
+    bool Enabled() const { return sets != 0; }
+    // nullptr: none, not owned
+    void Attach(Prefetcher *prefetcher) { this->prefetcher = prefetcher; }
+    int Access(AddrType addr, bool write, AddrType pc, long long now) override;
+    // an access to addr would miss with no MSHR free; counts the cycle as stalled
+    bool Full(AddrType addr, long long now);
+    // once a cycle, for the MSHR occupancy histogram
+    void Tick(long long now);
+    // `<name>_hits / _misses / _writebacks / _miss_rate / _amat` (average cycles an access takes),
+    // `<name>_mshr_merges / _mshr_full_cycles / _mshr_occupancy.<n>` (cycles with n taken, if Tick() is called),
+    // `<name>_prefetch_issued / _dropped / _useful / _late / _useless / _pollution / _accuracy / _coverage /
+    // _timeliness` with a prefetcher, and `<name>_site.<pc>.accesses / .misses` for the pcs that missed
+    // (accesses from the first miss on)
+    void PrintStats(std::ostream &os, const std::string &name) const;
+
+  private:
+    struct Line {
+        bool valid{false}, dirty{false};
+        bool prefetched{false}; // not used by a demand access yet
+        bool displaced{false};  // a prefetch into this way evicted displaced_tag
+        AddrType tag{0}, displaced_tag{0};
+        uint64_t last_use{0}; // Lru
+    };
+    struct Site {
+        long long accesses{0}, misses{0};
+    };
+    struct Mshr {
+        AddrType block;
+        long long ready; // cycle the line is there
+    };
+
+    int Victim(int set);
+    void Touch(int set, int way);
+    bool Present(AddrType block) const;
+    // puts block in, in place of a victim; cycles until it is there
+    int Fill(AddrType block, bool write, bool prefetch, AddrType pc, long long now);
+    void Prefetch(AddrType addr, AddrType pc, long long now);
+    // frees the MSHRs whose line is there by now
+    void Retire(long long now);
+
+    int sets{0}, assoc, line_bits{0};
+    ReplacePolicy policy;
+    int hit_latency, miss_latency;
+    MemoryLevel *next;
+    size_t mshrs;
+    std::vector<Mshr> pending;
+    std::vector<Line> lines;   // sets * assoc
+    std::vector<uint8_t> plru; // sets * assoc, a tree in 1 .. assoc - 1 of every set
+    uint64_t tick{0};
+    uint32_t random_state{2463534242U};
+    long long hits{0}, misses{0}, writebacks{0}, latency_sum{0};
+    long long merges{0}, full_cycles{0}, last_full{-1};
+    std::vector<long long> occupancy; // cycles with [n] MSHRs taken
+    Prefetcher *prefetcher{nullptr};
+    std::vector<AddrType> prefetches;
+    long long prefetch_issued{0}, prefetch_dropped{0}, prefetch_useful{0}, prefetch_late{0};
+    long long prefetch_useless{0}, prefetch_pollution{0};
+    std::map<AddrType, Site> sites; // added on the first miss of a pc
+};
+
+} // namespace jasonfxz
+
+#endif // CACHE_H
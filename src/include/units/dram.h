@@ -0,0 +1,58 @@
+/**
+ * @file dram.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief DRAM timing model with banks, open row buffers and a bounded request queue
+ * @version 0.1
+ * @date 2024-08-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef DRAM_H
+#define DRAM_H
+
+#include "config/types.h"
+#include "units/cache.h"
+#include <ostream>
+#include <vector>
+
+namespace jasonfxz {
+
+/**
+ * Open-page policy: a bank keeps the last row it read in its row buffer. A
+ * request to that row takes row_hit, to a bank with no row open row_miss, to
+ * another row row_conflict. Rows are interleaved over the banks, a bank does
+ * one request at a time, so a request waits for the bank to be free first.
+ * At most `queue` requests are in flight, a new one waits for the first of
+ * them to be done. Writebacks go through the same queue and banks.
+ * banks 0: no DRAM.
+ */
+class Dram : public MemoryLevel {
+  public:
+    Dram(int banks, int row_size, int row_hit, int row_miss, int row_conflict, int queue);
+    bool Enabled() const { return !banks.empty(); }
+    int Access(AddrType addr, bool write, AddrType pc, long long now) override;
+    // `dram_accesses / _row_hits / _row_misses / _row_conflicts / _queue_waits` (cycles spent for a free
+    // queue entry), `_bank_waits` (cycles spent for a free bank) and `_amat`
+    void PrintStats(std::ostream &os) const;
+
+  private:
+    struct Bank {
+        bool open{false};
+        AddrType row{0};
+        long long free_at{0}; // cycle
+    };
+
+    std::vector<Bank> banks;
+    int row_bits{0};
+    int row_hit, row_miss, row_conflict;
+    size_t queue;
+    std::vector<long long> in_flight; // cycles the requests in the queue are done at
+    long long accesses{0}, row_hits{0}, row_misses{0}, row_conflicts{0};
+    long long queue_waits{0}, bank_waits{0}, latency_sum{0};
+};
+
+} // namespace jasonfxz
+
+#endif // DRAM_H
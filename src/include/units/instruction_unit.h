@@ -15,8 +15,13 @@
 #include "config/types.h"
 #include "config/constant.h"
 #include "circuits/cqueue.h"
+#include "config/machine_desc.h"
+#include "units/branch_predictor.h"
+#include "units/cache.h"
 #include "units/memory_unit.h"
+#include "units/target_predictor.h"
 #include <cstring>
+#include <ostream>
 
 namespace jasonfxz {
 
@@ -39,40 +44,68 @@ class Decoder {
     void Decode(InsType &ins);
 };
 
-class Predictor {
-  private:
-    char table[1 << 5];
-    int count_tot{0}, count_suc{0};
-  public:
-    Predictor() {
-        for (int i = 0; i < (1 << 5); ++i) {
-            table[i] = 1;
-        }
-    }
-    bool GetPrediction(AddrType pc);
-    void GetFeedBack(AddrType pc, bool real, bool pred);
-    ~Predictor() {
-        auto rate = count_tot == 0 ? 100.0 : 100.0 * count_suc / count_tot;
-        std::cerr << "Predictor " << count_suc << " / " << count_tot << " = " << rate << "%" << std::endl;
-    }
-};
-
-
-
+/**
+ * With an icache, fetch reads aligned blocks of icache_line bytes into a buffer
+ * of fetch_buffer blocks, one request at a time, each as slow as the icache
+ * says. The block after the last one buffered is asked for as soon as there is
+ * room, so straight-line code does not wait on hits; a jump elsewhere throws the
+ * buffer away. Decode only goes on while the block of pc is in the buffer.
+ * Up to fetch_width instructions are fetched and decoded in a cycle, along
+ * straight-line code: a group ends after a predicted-taken branch, a jump, or
+ * where the buffer ends. Up to issue_width are issued from ins_queue in order;
+ * the first one that finds its RS / LSB / ROB full stops the rest of the group.
+ * An operand that has been written back but not committed is read from the ROB
+ * at issue, through one of rob_read_ports; with none left, the instruction and
+ * the rest of the group wait for the next cycle. An instruction that needs two
+ * reads with one port left reads rs1 now and rs2 in a later cycle.
+ */
+template <typename Config>
 class InstructionUnit : public BaseUnit {
   public:
-    explicit InstructionUnit(Predictor *predictor, Memory *mem) : predictor(predictor), mem(mem) {}
+    InstructionUnit(Predictor *predictor, TargetPredictor *target_predictor, Memory *mem, Cache *icache,
+                    const MachineDesc &desc)
+        : predictor(predictor), target_predictor(target_predictor), mem(mem), icache(icache),
+          fetch_width(desc.fetch_width), issue_width(desc.issue_width), rob_read_ports(desc.rob_read_ports),
+          rob_size(desc.rob_size),
+          line(desc.icache_line) {
+        ins_queue.Resize(desc.ins_size);
+        fetch_blocks.Resize(desc.fetch_buffer);
+    }
     void Flush(State *cur_state) override;
     void Execute(State *cur_state, State *next_state) override;
+    long long FetchedBytes() const { return fetched_bytes; }
+    // fetch_empty_cycles / fetched_bytes, as `key = value`
+    void PrintStats(std::ostream &os) const;
+    // rob_port_reads / rob_port_stalls, as `key = value`
+    void PrintIssueStats(std::ostream &os) const;
 
   private:
     void Issue(State *cur_state, State *next_state);
     void FetchDecode(State *cur_state, State *next_state);
+    // decodes and predicts the one at pc; true if fetch goes on to pc + 4
+    bool FetchOne(AddrType pc, DataType ir, int clock, State *next_state);
+    // one cycle of the fetch buffer; true if it has the instruction at pc
+    bool Fetch(AddrType pc, int clock);
+    // the block of pc is in the fetch buffer
+    bool Buffered(AddrType pc);
 
     Decoder decoder;
     Predictor *predictor;
+    TargetPredictor *target_predictor;
     Memory *mem;
-    Cqueue<InsType, MAX_INS_SIZE> ins_queue;
+    Cache *icache;
+    Cqueue<InsType, Config::MAX_INS_SIZE> ins_queue;
+    SeqType next_seq{0};
+    int fetch_width, issue_width, rob_read_ports, rob_size;
+
+    int line;
+    Cqueue<AddrType, DYNAMIC_SIZE> fetch_blocks; // addresses, in order
+    bool fetching{false};
+    AddrType fetching_block{0};
+    int fetch_left{0};
+    long long fetched_bytes{0}, empty_cycles{0};
+    bool front_read{false}; // the front of ins_queue has read rs1 from the ROB already
+    long long port_reads{0}, port_stalls{0}; // port_stalls: cycles issue waited for a ROB read port
 };
 
 
@@ -18,7 +18,12 @@
 #include "circuits/cqueue.h"
 #include "config/types.h"
 #include "config/constant.h"
+#include "config/machine_desc.h"
+#include "units/cache.h"
 #include "units/memory_unit.h"
+#include "units/store_set_predictor.h"
+#include <ostream>
+#include <vector>
 
 namespace jasonfxz {
 
@@ -32,31 +37,102 @@ struct LsbInter {
     int rob_pos;
     AddrType addr{0};
     bool addr_ready{0}; // 0: not ready, 1: ready; 
+    SeqType seq{-1};
+    AddrType ins_addr{0}; // LOAD: fetched again from here on a replay
+    // STORE: comes from the RS together with the address, for forwarding
+    // LOAD: the data, once it is known
+    int data{0};
+    bool data_ready{false};
+    int store_set{-1}; // STORE: from StoreSetPredictor
+    // LOAD
+    bool issued{false};
+    int counter{0};       // cycles since it was issued
+    int latency{0};       // cycles it takes
+    bool written{false};  // its data is on the bus
+    int ticket{-1};       // its data has asked for the bus in this cycle
+    SeqType source{-1};   // the store it took its data from, -1: memory
+    SeqType wait_for{-1}; // the store StoreSetPredictor makes it wait for, -1: none
+    bool held{false};     // has waited for it with its address known
 };
 
+/**
+ * Loads stay in load_queue until they commit, stores in store_queue until they
+ * are written, both in program order. Up to load_ports loads start in a cycle,
+ * any that have their address, oldest first, and up to outstanding_loads are in
+ * flight; they complete in any order, and one that loses the bus tries again
+ * in the next cycle. With a dcache, how long a load or a store takes
+ * is up to it, else it is load_latency / store_latency; one that would miss
+ * with every MSHR taken waits, and the loads after it may still go. The youngest older store that writes any
+ * of its bytes gives a load its data (store-to-load forwarding); if that store
+ * writes only part of them, the load waits until it is written. No such store:
+ * the data comes from memory.
+ * An older store whose address is still unknown is taken not to write the same
+ * bytes. When its address comes and it does, the load read too early: it is
+ * squashed with everything after it and fetched again (a replay). Loads that
+ * have done so before are made to wait for the store by StoreSetPredictor.
+ * A committed store is written from the front of store_queue. Without a
+ * store buffer the ROB waits for it (StoreSuccess); with one, the ROB retires
+ * it as soon as there is room for it among the store_buffer committed stores,
+ * and it is written in the background, together with the committed stores
+ * right after it in the same line. Until then loads forward from it as from
+ * any other store.
+ */
 
+template <typename Config>
 class LoadStoreBuffer : public BaseUnit {
   public:
-    explicit LoadStoreBuffer(CdBus *cd_bus, Memory *mem) : cd_bus(cd_bus), mem(mem) {}
+    LoadStoreBuffer(CdBus<Config> *cd_bus, Memory *mem, Cache *dcache, const MachineDesc &desc)
+        : load_latency(desc.load_latency), store_latency(desc.store_latency), load_ports(desc.load_ports),
+          max_outstanding(desc.outstanding_loads),
+          store_buffer(desc.store_buffer), line(desc.dcache_line), store_sets(desc.ssit_size, desc.lfst_size),
+          port_busy(desc.load_ports), cd_bus(cd_bus), mem(mem), dcache(dcache) {
+        load_queue.Resize(desc.lsb_size);
+        store_queue.Resize(desc.lsb_size);
+    }
     void Flush(State *cur_state) override;
     void Execute(State *cur_state, State *next_state) override;
-    
+    // load_forwards / load_speculative / load_violations / load_waits / load_violations_avoided,
+    // lsb_bus_stalls, stores_drained / store_drains / stores_coalesced / store_drain_rate (stores a cycle) /
+    // store_buffer_occupancy, load_port<i>_busy / _utilization, as `key = value`
+    void PrintStats(std::ostream &os) const;
 
   private:
-    int load_latency = 3;
-    int store_latency = 3;
-
-    int load_counter = 0;
+    // false if it has to wait
+    bool StartLoad(LsbInter &load, int clock);
+    // complete the loads in flight, then start new ones
+    void ExecuteLoads(int clock);
+    // a store has got its address: look for a younger load that read its bytes too early
+    void CheckOrder(const LsbInter &store);
+    // the stores being written are in memory now
+    void Drain();
+    // what asked for the bus in the last cycle and got it is done, the rest asks again
+    void Granted();
+
+    int load_latency;
+    int store_latency;
+
+    int load_ports;
+    int max_outstanding;
+    int store_buffer; // committed stores waiting to be written
+    int line;         // stores in the same line are written together
+    int committed{0}; // at the front of store_queue
+    int draining{0};  // being written, at the front of store_queue
     int store_counter = 0;
-
-    bool store_enable = false; // Wait for ROB commit
-    int store_data;
-    
-    int load_enable_level = 0; // Wait for store
-  
-    Cqueue<pair<int, LsbInter>, MAX_LSB_SIZE> load_queue, store_queue;
-    CdBus *cd_bus;
+    int store_wait = 0; // cycles the store being written takes
+    int store_ticket{-1}; // its StoreSuccess has asked for the bus in this cycle
+
+    pair<bool, LsbInter> replay{false, LsbInter()}; // the oldest load that read too early
+    StoreSetPredictor store_sets;
+    long long forwards{0}, speculative{0}, violations{0};
+    long long waits{0}, avoided{0}; // avoided: the store a load waited for wrote its bytes
+    long long cycles{0}, bus_stalls{0};
+    long long drained{0}, drains{0}, coalesced{0}, buffered{0}; // buffered: committed stores, summed over the cycles
+    std::vector<long long> port_busy; // cycles each port started a load
+
+    Cqueue<LsbInter, Config::MAX_LSB_SIZE> load_queue, store_queue;
+    CdBus<Config> *cd_bus;
     Memory *mem;
+    Cache *dcache;
 };
 
 
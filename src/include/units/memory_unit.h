@@ -24,14 +24,14 @@ struct Memory {
   private:
     ByteType data[MAX_RAM_SIZE];  /// Memory
   public:
-  friend class Simulator;
+  template <typename Config> friend class Simulator;
     Memory();
     void clear();
     ByteType &operator[](AddrType addr);
-    ByteType ReadByte(AddrType addr);
-    ByteType ReadByteU(AddrType addr);
-    HalfType ReadHalf(AddrType addr);
-    HalfType ReadHalfU(AddrType addr);
+    DataType ReadByte(AddrType addr); // sign-extended
+    DataType ReadByteU(AddrType addr);
+    DataType ReadHalf(AddrType addr); // sign-extended
+    DataType ReadHalfU(AddrType addr);
     DataType ReadWord(AddrType addr);
     void WriteByte(AddrType addr, ByteType data);
     void WriteHalf(AddrType addr, HalfType data);
@@ -0,0 +1,105 @@
+/**
+ * @file prefetcher.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief data prefetchers (next-line / stride / stream) that watch the L1D accesses
+ * @version 0.1
+ * @date 2024-08-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include "config/types.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jasonfxz {
+
+struct MachineDesc;
+
+/**
+ * Observe() sees every demand access of the cache it is attached to, in the
+ * order they are made, and says which addresses to prefetch; the cache drops
+ * the ones it has already or has no MSHR for.
+ */
+class Prefetcher {
+  public:
+    virtual ~Prefetcher() = default;
+    // for Simulator snapshots: the cache keeps pointing to the same object
+    virtual std::unique_ptr<Prefetcher> Clone() const = 0;
+    virtual void Assign(const Prefetcher &other) = 0;
+    // appends the addresses to prefetch
+    virtual void Observe(AddrType pc, AddrType addr, bool hit, std::vector<AddrType> &prefetches) = 0;
+};
+
+template <typename Derived>
+class PrefetcherBase : public Prefetcher {
+  public:
+    std::unique_ptr<Prefetcher> Clone() const override {
+        return std::make_unique<Derived>(static_cast<const Derived &>(*this));
+    }
+    void Assign(const Prefetcher &other) override {
+        static_cast<Derived &>(*this) = static_cast<const Derived &>(other);
+    }
+};
+
+// on a miss, the `degree` lines after it
+class NextLinePrefetcher : public PrefetcherBase<NextLinePrefetcher> {
+  public:
+    NextLinePrefetcher(int line, int degree) : line(line), degree(degree) {}
+    void Observe(AddrType pc, AddrType addr, bool hit, std::vector<AddrType> &prefetches) override;
+  private:
+    int line, degree;
+};
+
+// reference prediction table indexed by pc: once the same stride is seen twice, `degree` strides ahead
+class StridePrefetcher : public PrefetcherBase<StridePrefetcher> {
+  public:
+    StridePrefetcher(int size, int degree) : table(size), degree(degree) {}
+    void Observe(AddrType pc, AddrType addr, bool hit, std::vector<AddrType> &prefetches) override;
+  private:
+    struct Entry {
+        bool valid{false};
+        AddrType pc{0}, last{0};
+        int32_t stride{0};
+        uint8_t confidence{0}; // 2-bit
+    };
+    std::vector<Entry> table;
+    int degree;
+};
+
+/**
+ * Stream buffers: a miss that no stream expects starts one, the least recently
+ * used, running `degree` lines ahead of it. An access inside the window of a
+ * stream moves the stream up to it and keeps it `degree` lines ahead.
+ * Ascending streams only.
+ */
+class StreamPrefetcher : public PrefetcherBase<StreamPrefetcher> {
+  public:
+    StreamPrefetcher(int line, int streams, int degree) : line(line), streams(streams), degree(degree) {}
+    void Observe(AddrType pc, AddrType addr, bool hit, std::vector<AddrType> &prefetches) override;
+  private:
+    struct Stream {
+        bool valid{false};
+        AddrType next{0}; // first line of the window
+        uint64_t last_use{0};
+    };
+    void Ahead(AddrType block, std::vector<AddrType> &prefetches) const;
+    int line;
+    std::vector<Stream> streams;
+    int degree;
+    uint64_t tick{0};
+};
+
+// nullptr for "none", throw std::runtime_error if desc.prefetcher is unknown
+std::unique_ptr<Prefetcher> MakePrefetcher(const MachineDesc &desc);
+std::vector<std::string> PrefetcherNames();
+
+} // namespace jasonfxz
+
+#endif // PREFETCHER_H
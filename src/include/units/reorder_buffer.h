@@ -17,10 +17,15 @@
 #include "config/constant.h"
 #include "circuits/bus.h"
 #include "circuits/cqueue.h"
+#include "config/machine_desc.h"
+#include <array>
+#include <vector>
+#include <utility>
 
 namespace jasonfxz {
 
 class Predictor;
+class TargetPredictor;
 
 enum class RobState {
     Issue, // Issue
@@ -35,24 +40,52 @@ struct RobInter {
     int rob_pos;
     int dest;
     int data;
+    AddrType target{0}; // JALR: computed by the ALU
+    // the recorder of dest before this one renamed it, to take a group issued together apart
+    static constexpr int NO_RENAME = -2;
+    int old_recorder{NO_RENAME};
 };
 
 class State;
 
+template <typename Config>
 class ReorderBuffer : public BaseUnit {
   public:
-    explicit ReorderBuffer(CdBus *cd_bus, Predictor *predictor) : cd_bus(cd_bus), predictor(predictor) {}
+    ReorderBuffer(CdBus<Config> *cd_bus, Predictor *predictor, TargetPredictor *target_predictor,
+                  const MachineDesc &desc)
+        : checkpoints(desc.rob_size + 1), rob_data(desc.rob_size + 1, {false, 0}), cd_bus(cd_bus), predictor(predictor), target_predictor(target_predictor),
+          store_buffer(desc.store_buffer > 0), commit_width(desc.commit_width) {
+        rob_queue.Resize(desc.rob_size);
+    }
     void Flush(State *cur_state) override;
     void Execute(State *cur_state, State *next_state) override;
     void Print();
+    long long CommitCount() const { return commit_count; }
+    long long MispredictCount() const { return mispredict_count; }
+    long long MispredictCycles() const { return mispredict_cycles; }
 
   private:
-    void Commit(State *cur_state, State *next_state);
+    // commits the head of the ROB if it is done; false: nothing more to commit in this cycle
+    bool CommitFront(State *next_state, int &store_buffer_free);
+    // drop the instructions cur_state->squash throws away, put back the renaming and the
+    // predictors: from the checkpoints of the branch or the replayed load, or else from what has committed
+    void Squash(State *cur_state);
+    // the renaming left by the instructions in the ROB
+    void WalkRenaming(State *cur_state);
   private:
-    Cqueue<RobInter, MAX_ROB_SIZE> rob_queue;
-    CdBus *cd_bus;
+    Cqueue<RobInter, Config::MAX_ROB_SIZE> rob_queue;
+    // BRANCH: the recorder of every register right after it was issued
+    std::vector<std::array<int, REG_FILE_SIZE>> checkpoints;
+    // of every rob_pos: the data, if it has been written back; kept up to date for State::rob_data
+    std::vector<std::pair<bool, int>> rob_data;
+    CdBus<Config> *cd_bus;
     Predictor *predictor;
+    TargetPredictor *target_predictor;
+    bool store_buffer; // a store retires into the LSB's store buffer instead of waiting for StoreSuccess
+    int commit_width;
     bool StoreSuccessFlag{false};
+    long long commit_count{0};
+    long long mispredict_count{0}, mispredict_cycles{0};
 };
 
 } // namespace jasonfxz
@@ -16,7 +16,11 @@
 #include "base_unit.h"
 #include "circuits/bus.h"
 #include "circuits/carray.h"
+#include "config/machine_desc.h"
+#include "units/arithmetic_logic_unit.h"
 #include <ostream>
+#include <utility>
+#include <vector>
 
 namespace jasonfxz {
 
@@ -37,24 +41,44 @@ struct RsInter {
     }
 };
 
+template <typename Config>
 class ReservationStation : public BaseUnit {
   public:
-    explicit ReservationStation(CdBus *cd_bus) : cd_bus(cd_bus) {}
+    ReservationStation(CdBus<Config> *cd_bus, const MachineDesc &desc) : update(desc.rob_size + 1), cd_bus(cd_bus) {
+        for (auto &rs : rss) rs.Resize(desc.rs_size);
+    }
+    // the named references below must keep pointing into our own rss
+    ReservationStation(const ReservationStation &other) : update(other.update), cd_bus(other.cd_bus) {
+        for (int i = 0; i < RS_COUNT; ++i) rss[i] = other.rss[i];
+    }
+    ReservationStation &operator=(const ReservationStation &other) {
+        for (int i = 0; i < RS_COUNT; ++i) rss[i] = other.rss[i];
+        update = other.update;
+        cd_bus = other.cd_bus;
+        return *this;
+    }
     void Flush(State *cur_state) override;
     void Execute(State *cur_state, State *next_state) override;
     
   protected:
     void ExecuteALU(State *cur_state, State *next_state);
+    // up to `width` ready entries of rs, oldest first, into inters
+    void Select(Carray<RsInter, Config::MAX_RS_SIZE> &rs, int width, std::vector<AluInter> &inters);
     void ExecuteLSB(State *cur_state, State *next_state);
     void Print();
   private:
-    Carray<RsInter, MAX_RS_SIZE> rss[5];
-    Carray<RsInter, MAX_RS_SIZE> &alu_add_rs = rss[0];
-    Carray<RsInter, MAX_RS_SIZE> &alu_camp_rs = rss[1];
-    Carray<RsInter, MAX_RS_SIZE> &alu_logic_rs = rss[2];
-    Carray<RsInter, MAX_RS_SIZE> &alu_shift_rs = rss[3];
-    Carray<RsInter, MAX_RS_SIZE> &lsb_rs = rss[4];
-    CdBus *cd_bus;
+    static constexpr int RS_COUNT = MachineDesc::RS_COUNT;
+    Carray<RsInter, Config::MAX_RS_SIZE> rss[RS_COUNT];
+    Carray<RsInter, Config::MAX_RS_SIZE> &alu_add_rs = rss[0];
+    Carray<RsInter, Config::MAX_RS_SIZE> &alu_camp_rs = rss[1];
+    Carray<RsInter, Config::MAX_RS_SIZE> &alu_logic_rs = rss[2];
+    Carray<RsInter, Config::MAX_RS_SIZE> &alu_shift_rs = rss[3];
+    Carray<RsInter, Config::MAX_RS_SIZE> &lsb_rs = rss[4];
+    Carray<RsInter, Config::MAX_RS_SIZE> &alu_mul_rs = rss[5];
+    Carray<RsInter, Config::MAX_RS_SIZE> &alu_div_rs = rss[6];
+    std::vector<std::pair<bool, int>> update; // data of each rob_pos seen in this cycle
+    std::vector<int> ready; // Select(), scratch
+    CdBus<Config> *cd_bus;
 };
 
 
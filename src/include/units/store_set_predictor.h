@@ -0,0 +1,58 @@
+/**
+ * @file store_set_predictor.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief store set memory dependence prediction, so that only the loads that alias an older store wait for it
+ * @version 0.1
+ * @date 2024-08-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef STORE_SET_PREDICTOR_H
+#define STORE_SET_PREDICTOR_H
+
+#include "config/types.h"
+#include <vector>
+
+namespace jasonfxz {
+
+/**
+ * Store sets (Chrysos & Emer): the SSIT maps the pc of a load or a store to its
+ * store set, the LFST keeps the last store of every set that has been dispatched
+ * and has no address yet. A load waits for the store the LFST has for its set,
+ * every other load goes ahead of the stores with unknown addresses.
+ * Sets are made by Violation(): the load and the store go into one set, the
+ * smaller one when both have a set already. The SSIT is cleared every
+ * CLEAR_PERIOD lookups, so that sets that no longer alias go away.
+ * ssit_size 0: never waits.
+ */
+class StoreSetPredictor {
+  public:
+    static constexpr int CLEAR_PERIOD = 1 << 15;
+
+    StoreSetPredictor(int ssit_size, int lfst_size) : ssit(ssit_size, -1), lfst(lfst_size, -1) {}
+    bool Enabled() const { return !ssit.empty(); }
+    // Load() / Store() are called at dispatch, in program order
+    // the store the load has to wait for, -1: none
+    SeqType Load(AddrType pc);
+    // the set of the store, -1: none
+    int Store(AddrType pc, SeqType seq);
+    // the store has its address: nothing dispatched later has to wait for it
+    void Resolve(int set, SeqType seq) {
+        if (set != -1 && lfst[set] == seq) lfst[set] = -1;
+    }
+    void Violation(AddrType load_pc, AddrType store_pc);
+
+  private:
+    int &Entry(AddrType pc) { return ssit[(pc >> 2) & (ssit.size() - 1)]; }
+    void Tick();
+
+    std::vector<int> ssit;      // store set, -1: none
+    std::vector<SeqType> lfst;  // last store, -1: none
+    int tick{0};
+};
+
+} // namespace jasonfxz
+
+#endif // STORE_SET_PREDICTOR_H
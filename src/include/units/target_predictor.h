@@ -0,0 +1,158 @@
+/**
+ * @file target_predictor.h
+ * @author JasonFan (jasonfanxz@gmail.com)
+ * @brief jump target prediction (BTB / ITTAGE / return address stack) so fetch need not stall on JALR
+ * @version 0.1
+ * @date 2024-08-11
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TARGET_PREDICTOR_H
+#define TARGET_PREDICTOR_H
+
+#include "config/types.h"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <vector>
+
+namespace jasonfxz {
+
+// circular: a push on a full stack overwrites the oldest entry, size 0: always empty
+class ReturnAddressStack {
+  public:
+    explicit ReturnAddressStack(int size) : stack(size) {}
+    void Push(AddrType addr);
+    bool Pop(AddrType &addr); // false if empty
+    // only the pointer comes back, entries overwritten since are lost
+    void Save(int &top, int &count) const {
+        top = this->top;
+        count = this->count;
+    }
+    void Rewind(int top, int count) {
+        this->top = top;
+        this->count = count;
+    }
+
+  private:
+    std::vector<AddrType> stack;
+    int top{0}, count{0};
+};
+
+// direct mapped, tagged by the whole pc, size 0: always miss
+class BranchTargetBuffer {
+  public:
+    explicit BranchTargetBuffer(int size) : table(size) {}
+    bool Lookup(AddrType pc, AddrType &target) const;
+    void Update(AddrType pc, AddrType target);
+
+  private:
+    struct Entry {
+        bool valid{false};
+        AddrType pc{0}, target{0};
+    };
+    std::vector<Entry> table;
+};
+
+/**
+ * ITTAGE: TagePredictor with a target instead of a direction in every entry.
+ * The tables are indexed and tagged by the pc hashed with longer and longer
+ * slices of the path history, the longest hit provides the target, unless its
+ * confidence is 0 and a shorter one hits too. size 0: always miss.
+ */
+class IttagePredictor {
+  public:
+    static constexpr int TABLES = 4;
+    static constexpr int TAG_BITS = 9;
+    static constexpr std::array<int, TABLES> HISTORY_LENGTH{4, 10, 25, 64};
+    static constexpr int USEFUL_RESET_PERIOD = 1 << 16; // jumps between halving every u
+
+    explicit IttagePredictor(int size);
+    bool Lookup(AddrType pc, uint64_t history, AddrType &target) const;
+    // with the history the jump was predicted with; base_ok: the BTB has the right target
+    void Update(AddrType pc, uint64_t history, AddrType target, bool base_ok);
+
+  private:
+    struct Entry {
+        bool valid{false}; // allocated: tag 0 does not hit an empty entry
+        uint16_t tag{0};
+        AddrType target{0};
+        uint8_t ctr{0}; // 2-bit confidence
+        uint8_t u{0};   // 2-bit useful
+    };
+    struct Find {
+        int provider{-1}, alt{-1}; // table, -1: none
+        int index[TABLES];
+        uint16_t tag[TABLES];
+    };
+    Find Search(AddrType pc, uint64_t history) const;
+    // the entry Lookup() takes its target from, -1: none
+    int Chosen(const Find &find) const;
+
+    int index_bits{0};
+    std::vector<Entry> tables[TABLES];
+    int tick{0};
+};
+
+/**
+ * Predict() is called at fetch for JAL / JALR and marks the instruction with
+ * what it did to the speculative return address stack; Commit() repeats that
+ * on the committed stack in program order. As with the direction predictor,
+ * the squash of a JALR at commit only needs Recover() to copy the committed stack back.
+ * A call is JAL / JALR with rd = ra, a return is `jalr x0, ra`.
+ *
+ * Other JALRs ask ITTAGE first and the BTB if it misses. ITTAGE hashes a path
+ * history of conditional branch directions and JALR targets, which is kept the
+ * same way: Branch() / CommitBranch() shift in a direction at fetch / commit.
+ * A branch mispredicted at execute, or a replayed load, goes back with Save() / Restore(), as in Predictor.
+ */
+class TargetPredictor {
+  public:
+    TargetPredictor(int btb_size, int ras_size, int ittage_size)
+        : btb(btb_size), ittage(ittage_size), spec_ras(ras_size), commit_ras(ras_size) {}
+    void Predict(InsType &ins);
+    // target: the real target of a JALR
+    void Commit(const InsType &ins, AddrType target);
+    void Branch(bool taken) { spec_path = spec_path << 1 | taken; }
+    void CommitBranch(bool taken) { commit_path = commit_path << 1 | taken; }
+    void Recover() {
+        spec_ras = commit_ras;
+        spec_path = commit_path;
+    }
+    void Save(PredictorCheckpoint &checkpoint) const {
+        checkpoint.path = spec_path;
+        spec_ras.Save(checkpoint.ras_top, checkpoint.ras_count);
+    }
+    void Restore(const PredictorCheckpoint &checkpoint, bool taken) {
+        spec_path = checkpoint.path << 1 | taken;
+        spec_ras.Rewind(checkpoint.ras_top, checkpoint.ras_count);
+    }
+    void Restore(const PredictorCheckpoint &checkpoint) {
+        spec_path = checkpoint.path;
+        spec_ras.Rewind(checkpoint.ras_top, checkpoint.ras_count);
+    }
+    // also `jalr_site.<pc>.count / miss` for every JALR that is not a return
+    void PrintStats(std::ostream &os) const;
+
+  private:
+    static uint64_t PathWith(uint64_t path, AddrType target) { return path << 2 ^ target >> 2; }
+
+    struct Site {
+        long long count{0}, miss{0}; // miss: no target or a wrong one
+    };
+
+    BranchTargetBuffer btb;
+    IttagePredictor ittage;
+    ReturnAddressStack spec_ras, commit_ras;
+    uint64_t spec_path{0}, commit_path{0}; // newest in the low bits
+    long long jalr_count{0}, ras_predicted{0}, ras_hits{0};
+    long long btb_predicted{0}, btb_hits{0}, ittage_predicted{0}, ittage_hits{0};
+    std::map<AddrType, Site> sites;
+};
+
+} // namespace jasonfxz
+
+#endif // TARGET_PREDICTOR_H
@@ -1,62 +1,129 @@
-
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "co_simulator.h"
+#include "config/machine_desc.h"
 #include "naive_simulator.h"
+#include "predictor_evaluator.h"
 #include "simulator.h"
+#include "sweeper.h"
 #include "utils/utils.h"
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 
-int duipai() {
-    jasonfxz::NSimulator nsim;
-    jasonfxz::Simulator sim;
-    const char *inputFileName = "./testcases/bulgarian.data";
+// co-simulate the given program with the naive simulator
+int duipai(const jasonfxz::MachineDesc &desc, const char *inputFileName, int interval, int window, int keep) {
     std::ifstream inputFile(inputFileName, std::ios::in);
     if (!inputFile) {
         std::cerr << "Failed to open input file" << std::endl;
         return 1;
     }
-    sim.Init(inputFile);
-    inputFile.close();
-    inputFile.open(inputFileName, std::ios::in);
-    nsim.Init(inputFile);
-    inputFile.close();
-    jasonfxz::DebugRecord last;
-    int step_count = 0;
-    while (true) {
-        ++step_count;
-        jasonfxz::DebugRecord ans, out;
-        if (step_count == 94) {
-            sim.enable_debug = true;
-            nsim.enable_debug = true;
-        }
-        bool nflag = nsim.Step(ans);
-        bool flag = sim.Step(out);
-        assert(nflag == flag);
-        if (nflag == false) break;
-        if (!(ans == out)) {
-            std::cerr << "Different output" << std::endl;
-            ans.Print();
-            std::cerr << "vs" << std::endl;
-            out.Print();
-            std::cerr << "LAST OUTPUT" << std::endl;
-            last.Print();
-            std::cerr << "At step " << step_count << std::endl;
-            throw "Error";
+    jasonfxz::CoSimulator cosim(desc, interval, window, keep);
+    cosim.Init(inputFile);
+    return cosim.Run(std::cerr) ? 0 : 1;
+}
+
+// run the design-space sweep described in the given spec file,
+// or only its branch predictors on branch traces
+int sweep(const char *specFileName, bool predictor_only) {
+    std::ifstream specFile(specFileName, std::ios::in);
+    if (!specFile) {
+        std::cerr << "Failed to open sweep spec" << std::endl;
+        return 1;
+    }
+    try {
+        jasonfxz::SweepSpec spec;
+        spec.Load(specFile);
+        if (predictor_only) {
+            jasonfxz::PredictorEvaluator evaluator(spec);
+            evaluator.Run(std::cout);
+        } else {
+            jasonfxz::Sweeper sweeper(spec);
+            sweeper.Run(std::cout);
         }
-        last = ans;
+    } catch (const std::runtime_error &e) {
+        std::cerr << specFileName << ": " << e.what() << std::endl;
+        return 1;
     }
     return 0;
 }
 
-void omain() {
-    jasonfxz::Simulator sim;
-    sim.Init(std::cin);
-    int ans = sim.Run();
+int omain(const jasonfxz::MachineDesc &desc, const char *statsFileName) {
+    auto sim = jasonfxz::MakeSimulator(desc);
+    sim->Init(std::cin);
+    int ans = sim->Run();
     std::cout << ans << std::endl;
+    if (statsFileName != nullptr) {
+        std::ofstream statsFile(statsFileName, std::ios::out);
+        if (!statsFile) {
+            std::cerr << "Failed to open stats file" << std::endl;
+            return 1;
+        }
+        sim->PrintStats(statsFile);
+    } else {
+        sim->PrintStats(std::cerr);
+    }
+    return 0;
 }
 
-int main() {
-    // return duipai(); 
-    omain();
-    return 0;
-}
\ No newline at end of file
+// ./code [--config NAME] [--machine <file>] [--stats <file>]    program from stdin
+// ./code [--config NAME] [--machine <file>] --duipai <file.data> [--interval N] [--window N] [--keep N]
+// ./code --sweep <spec>                 (see sweeper.h)
+// ./code --predictor-eval <spec>        (see predictor_evaluator.h)
+// --machine overrides the sizes / latencies of --config (see config/machine_desc.h)
+int main(int argc, char *argv[]) {
+    std::string config = "default";
+    const char *machine_file = nullptr;
+    const char *stats_file = nullptr;
+    const char *duipai_file = nullptr;
+    const char *sweep_file = nullptr;
+    const char *predictor_eval_file = nullptr;
+    int interval = 100000, window = 200, keep = 4;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--config") == 0) config = argv[i + 1];
+        else if (strcmp(argv[i], "--machine") == 0) machine_file = argv[i + 1];
+        else if (strcmp(argv[i], "--stats") == 0) stats_file = argv[i + 1];
+        else if (strcmp(argv[i], "--duipai") == 0) duipai_file = argv[i + 1];
+        else if (strcmp(argv[i], "--sweep") == 0) sweep_file = argv[i + 1];
+        else if (strcmp(argv[i], "--predictor-eval") == 0) predictor_eval_file = argv[i + 1];
+        else if (strcmp(argv[i], "--interval") == 0) interval = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--window") == 0) window = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--keep") == 0) keep = atoi(argv[i + 1]);
+    }
+    if (sweep_file != nullptr) {
+        return sweep(sweep_file, false);
+    }
+    if (predictor_eval_file != nullptr) {
+        return sweep(predictor_eval_file, true);
+    }
+    auto names = jasonfxz::MachineConfigNames();
+    if (std::find(names.begin(), names.end(), config) == names.end()) {
+        std::cerr << "Unknown config " << config << ", available:";
+        for (const auto &name : names) std::cerr << " " << name;
+        std::cerr << std::endl;
+        return 1;
+    }
+    auto desc = jasonfxz::MachineDesc::Named(config);
+    try {
+        if (machine_file != nullptr) {
+            std::ifstream machineFile(machine_file, std::ios::in);
+            if (!machineFile) {
+                std::cerr << "Failed to open machine file" << std::endl;
+                return 1;
+            }
+            desc.Load(machineFile);
+        }
+        desc.Validate();
+    } catch (const std::runtime_error &e) {
+        std::cerr << (machine_file != nullptr ? machine_file : config.c_str()) << ": " << e.what() << std::endl;
+        return 1;
+    }
+    if (duipai_file != nullptr) {
+        return duipai(desc, duipai_file, interval, window, keep);
+    }
+    return omain(desc, stats_file);
+}
@@ -1,7 +1,7 @@
 /**
  * @file naive_simulator.cpp
  * @author JasonFan (jasonfanxz@gmail.com)
- * @brief A naive simulator for RISC-V RV32I
+ * @brief A naive simulator for RISC-V RV32IM
  * @version 0.1
  * @date 2024-07-25
  *
@@ -64,6 +64,52 @@ void NSimulator::ExeSLTU(int rd, int rs1, int rs2) {
     reg[rd] = reg[rs1] < reg[rs2] ? 1 : 0;
 }
 
+void NSimulator::ExeMUL(int rd, int rs1, int rs2) {
+    reg[rd] = reg[rs1] * reg[rs2];
+}
+
+void NSimulator::ExeMULH(int rd, int rs1, int rs2) {
+    reg[rd] = (int64_t)(int32_t)reg[rs1] * (int32_t)reg[rs2] >> 32;
+}
+
+void NSimulator::ExeMULHSU(int rd, int rs1, int rs2) {
+    reg[rd] = (int64_t)(int32_t)reg[rs1] * (int64_t)(uint32_t)reg[rs2] >> 32;
+}
+
+void NSimulator::ExeMULHU(int rd, int rs1, int rs2) {
+    reg[rd] = (uint64_t)reg[rs1] * reg[rs2] >> 32;
+}
+
+void NSimulator::ExeDIV(int rd, int rs1, int rs2) {
+    int32_t lhs = reg[rs1], rhs = reg[rs2];
+    if (rhs == 0) {
+        reg[rd] = -1;
+    } else if (lhs == INT32_MIN && rhs == -1) {
+        reg[rd] = lhs; // overflow
+    } else {
+        reg[rd] = lhs / rhs;
+    }
+}
+
+void NSimulator::ExeDIVU(int rd, int rs1, int rs2) {
+    reg[rd] = reg[rs2] == 0 ? 0xFFFFFFFF : reg[rs1] / reg[rs2];
+}
+
+void NSimulator::ExeREM(int rd, int rs1, int rs2) {
+    int32_t lhs = reg[rs1], rhs = reg[rs2];
+    if (rhs == 0) {
+        reg[rd] = lhs;
+    } else if (lhs == INT32_MIN && rhs == -1) {
+        reg[rd] = 0; // overflow
+    } else {
+        reg[rd] = lhs % rhs;
+    }
+}
+
+void NSimulator::ExeREMU(int rd, int rs1, int rs2) {
+    reg[rd] = reg[rs2] == 0 ? reg[rs1] : reg[rs1] % reg[rs2];
+}
+
 void NSimulator::ExeADDI(int rd, int rs1, int imm) {
     reg[rd] = reg[rs1] + imm;
 }
@@ -243,6 +289,7 @@ void NSimulator::FetchDecode() {
         std::cerr << std::dec;
         switch (ins.opt) {
         case ADD: case SUB: case AND: case OR: case XOR: case SLL: case SRL: case SRA: case SLT: case SLTU:
+        case MUL: case MULH: case MULHSU: case MULHU: case DIV: case DIVU: case REM: case REMU:
             std::cerr << OpcodeToStr(ins.opt) << " x" << ins.rd << ", x" << ins.rs1 << ", x" << ins.rs2 << std::endl; break;
         case ADDI: case ANDI: case ORI: case XORI: case SLTI: case SLTIU:
             std::cerr << OpcodeToStr(ins.opt) << " x" << ins.rd << ", x" << ins.rs1 << ", " << ins.imm << std::endl; break;
@@ -349,6 +396,11 @@ void nDecoder::DecodeR(Instruction &ins) {
         if (ins.funct7 == 0b000'0000) ins.opt = SLTU;
         break;
     }
+    if (ins.funct7 == 0b000'0001) {
+        // RV32M
+        static constexpr OpType M_OPS[8] = {MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU};
+        ins.opt = M_OPS[ins.funct3];
+    }
 }
 
 void nDecoder::DecodeI(Instruction &ins) {
@@ -497,6 +549,22 @@ void NSimulator::Execute() {
         ExeSLT(ins.rd, ins.rs1, ins.rs2); break;
     case SLTU:
         ExeSLTU(ins.rd, ins.rs1, ins.rs2); break;
+    case MUL:
+        ExeMUL(ins.rd, ins.rs1, ins.rs2); break;
+    case MULH:
+        ExeMULH(ins.rd, ins.rs1, ins.rs2); break;
+    case MULHSU:
+        ExeMULHSU(ins.rd, ins.rs1, ins.rs2); break;
+    case MULHU:
+        ExeMULHU(ins.rd, ins.rs1, ins.rs2); break;
+    case DIV:
+        ExeDIV(ins.rd, ins.rs1, ins.rs2); break;
+    case DIVU:
+        ExeDIVU(ins.rd, ins.rs1, ins.rs2); break;
+    case REM:
+        ExeREM(ins.rd, ins.rs1, ins.rs2); break;
+    case REMU:
+        ExeREMU(ins.rd, ins.rs1, ins.rs2); break;
     case ADDI:
         ExeADDI(ins.rd, ins.rs1, ins.imm); break;
     case ANDI:
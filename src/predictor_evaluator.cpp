@@ -0,0 +1,80 @@
+#include "predictor_evaluator.h"
+#include "config/machine_desc.h"
+#include "naive_simulator.h"
+#include "units/branch_predictor.h"
+#include "utils/utils.h"
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <stdexcept>
+
+namespace jasonfxz {
+
+BranchTrace ExtractBranchTrace(std::istream &is) {
+    auto nsim = std::make_unique<NSimulator>();
+    nsim->Init(is);
+    BranchTrace trace;
+    DebugRecord record;
+    while (nsim->Step(record)) {
+        ++trace.instructions;
+        if ((record.ir & 0x7F) != 0b110'0011) continue;
+        // imm[12|10:5] rs2 rs1 funct3 imm[4:1|11] opcode
+        int imm = (record.ir >> 31 & 1) << 12 | (record.ir >> 7 & 1) << 11 | (record.ir >> 25 & 0x3F) << 5
+                  | (record.ir >> 8 & 0xF) << 1;
+        AddrType target = record.pc + SEXT(imm, 13);
+        trace.branches.push_back(BranchRecord{record.pc, target, nsim->Pc() != record.pc + 4});
+    }
+    ++trace.instructions; // the halt
+    return trace;
+}
+
+PredictorEvaluator::PredictorEvaluator(const SweepSpec &spec) : spec(spec) {
+    for (const auto &param : spec.params) {
+        if (param.first != "predictor" && param.first != "predictor_size") {
+            throw std::runtime_error(param.first + " does not change a branch predictor");
+        }
+    }
+}
+
+void PredictorEvaluator::Run(std::ostream &os) {
+    std::vector<BranchTrace> traces(spec.programs.size());
+    ParallelFor(spec.threads, spec.programs.size(), [&](size_t i) {
+        std::ifstream is(spec.programs[i]);
+        if (!is) return;
+        traces[i] = ExtractBranchTrace(is);
+    });
+    for (size_t i = 0; i < spec.programs.size(); ++i) {
+        if (traces[i].instructions == 0) throw std::runtime_error("Failed to open " + spec.programs[i]);
+    }
+
+    auto points = spec.Points();
+    for (const auto &point : points) point.desc.Validate();
+    // one job per (program, point); each predictor sees its trace from start to end
+    std::vector<long long> hits(spec.programs.size() * points.size());
+    ParallelFor(spec.threads, hits.size(), [&](size_t i) {
+        const auto &trace = traces[i / points.size()];
+        auto predictor = MakePredictor(points[i % points.size()].desc);
+        for (const auto &branch : trace.branches) {
+            bool pred = predictor->GetPrediction(branch.pc);
+            // trained at once, not at commit as in the Simulator
+            predictor->GetFeedBack(branch.pc, branch.taken, pred);
+            if (pred != branch.taken) predictor->Recover(); // the squash
+        }
+        hits[i] = predictor->Hits();
+    });
+
+    os << "program";
+    for (const auto &param : spec.params) os << "\t" << param.first;
+    os << "\tbranches\tbranch_accuracy\tbranch_mpki" << std::endl;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const auto &trace = traces[i / points.size()];
+        long long branches = trace.branches.size();
+        os << spec.programs[i / points.size()];
+        for (const auto &value : points[i % points.size()].values) os << "\t" << value;
+        os << "\t" << branches << "\t" << std::fixed << std::setprecision(4)
+           << (branches == 0 ? 100.0 : 100.0 * hits[i] / branches) << "\t"
+           << 1000.0 * (branches - hits[i]) / trace.instructions << std::defaultfloat << std::endl;
+    }
+}
+
+} // namespace jasonfxz
@@ -1,6 +1,7 @@
 #include "simulator.h"
 #include "circuits/bus.h"
 #include "config/constant.h"
+#include "config/machine_config.h"
 #include "config/types.h"
 #include "units/instruction_unit.h"
 #include "units/register_file.h"
@@ -14,57 +15,173 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <iterator>
 #include <ostream>
 #include <ratio>
 #include <random>
+#include <stdexcept>
+#include <string>
 
 
 namespace jasonfxz {
 
 
-Simulator::Simulator() {
-    cd_bus = new CdBus();
-    predictor = new Predictor();
+template <typename Config>
+Simulator<Config>::Simulator(const MachineDesc &desc) : desc(desc) {
+    cd_bus = new CdBus<Config>();
+    cd_bus->Resize(desc.cdb_width);
+    cd_bus->policy = BusPolicyFrom(desc.cdb_policy);
+    predictor = MakePredictor(desc).release();
+    target_predictor = new TargetPredictor(desc.btb_size, desc.ras_size, desc.ittage_size);
+    dram = new Dram(desc.dram_banks, desc.dram_row_size, desc.dram_row_hit_latency, desc.dram_row_miss_latency,
+                    desc.dram_row_conflict_latency, desc.dram_queue);
+    l2 = new Cache(desc.l2_size, desc.l2_assoc, desc.l2_line, ReplacePolicyFrom(desc.l2_policy), desc.l2_hit_latency,
+                   desc.l2_miss_latency, dram->Enabled() ? dram : nullptr);
+    MemoryLevel *l1_next = l2->Enabled() ? (MemoryLevel *)l2 : dram->Enabled() ? (MemoryLevel *)dram : nullptr;
+    icache = new Cache(desc.icache_size, desc.icache_assoc, desc.icache_line, ReplacePolicyFrom(desc.icache_policy),
+                       desc.icache_hit_latency, desc.icache_miss_latency, l1_next);
+    dcache = new Cache(desc.dcache_size, desc.dcache_assoc, desc.dcache_line, ReplacePolicyFrom(desc.dcache_policy),
+                       desc.dcache_hit_latency, desc.dcache_miss_latency, l1_next, desc.dcache_mshrs);
+    prefetcher = MakePrefetcher(desc).release();
+    dcache->Attach(prefetcher);
     mem = new Memory();
-    units[0] = new LoadStoreBuffer(cd_bus, mem);
-    units[1] = new ReservationStation(cd_bus);
-    units[2] = new ArithmeticLogicUnit(cd_bus);
-    units[3] = new InstructionUnit(predictor, mem);
-    units[4] = new ReorderBuffer(cd_bus, predictor);
+    units[0] = lsb = new LoadStoreBuffer<Config>(cd_bus, mem, dcache, desc);
+    units[1] = rs = new ReservationStation<Config>(cd_bus, desc);
+    units[2] = alu = new ArithmeticLogicUnit<Config>(cd_bus, desc);
+    units[3] = iu = new InstructionUnit<Config>(predictor, target_predictor, mem, icache, desc);
+    units[4] = rob = new ReorderBuffer<Config>(cd_bus, predictor, target_predictor, desc);
+    units[5] = agu = new AddressGenerationUnit<Config>(cd_bus, desc);
 
 
     cur_state = nullptr;
     next_state = nullptr;
 }
 
-Simulator::~Simulator() {
+template <typename Config>
+Simulator<Config>::~Simulator() {
     delete cd_bus;
     delete predictor;
+    delete target_predictor;
+    delete icache;
+    delete dcache;
+    delete prefetcher;
+    delete l2;
+    delete dram;
     delete mem;
-    for (int i = 0; i < 5; i++) {
-        delete units[i];
+    for (auto *unit : units) {
+        delete unit;
     }
+    delete next_state;
     delete cur_state;
 }
 
-void Simulator::Init(std::istream &is) {
+template <typename Config>
+void Simulator<Config>::Init(std::istream &is) {
     mem->Init(is);
-    cur_state = nullptr;
-    next_state = new State;
+    pending.clear();
+    // the two states take turns, so a cycle does not allocate
+    if (cur_state == nullptr) cur_state = new State;
+    if (next_state == nullptr) next_state = new State;
+    cur_state->reset();
+    next_state->reset();
     next_state->pc = 0;
     next_state->clock = 0;
 }
-void Simulator::Flush() {
-    delete cur_state;
-    cur_state = next_state;
+
+template <typename Config>
+Simulator<Config>::Snapshot::Snapshot(const Simulator &sim)
+    : cur_state(*sim.cur_state), next_state(*sim.next_state), cd_bus(*sim.cd_bus),
+      predictor(sim.predictor->Clone()), target_predictor(*sim.target_predictor), icache(*sim.icache),
+      dcache(*sim.dcache), l2(*sim.l2), dram(*sim.dram),
+      prefetcher(sim.prefetcher == nullptr ? nullptr : sim.prefetcher->Clone()), mem(*sim.mem), lsb(*sim.lsb), rs(*sim.rs), alu(*sim.alu),
+      agu(*sim.agu), iu(*sim.iu), rob(*sim.rob), pending(sim.pending) {}
+
+template <typename Config>
+std::unique_ptr<BaseSimulator::Snapshot> Simulator<Config>::SaveSnapshot() const {
+    return std::make_unique<Snapshot>(*this);
+}
+
+template <typename Config>
+void Simulator<Config>::LoadSnapshot(const BaseSimulator::Snapshot &base_snap) {
+    const auto &snap = static_cast<const Snapshot &>(base_snap);
+    *cur_state = snap.cur_state;
+    *next_state = snap.next_state;
+    *cd_bus = snap.cd_bus;
+    predictor->Assign(*snap.predictor);
+    *target_predictor = snap.target_predictor;
+    *icache = snap.icache;
+    *dcache = snap.dcache;
+    *l2 = snap.l2;
+    *dram = snap.dram;
+    if (prefetcher != nullptr) prefetcher->Assign(*snap.prefetcher);
+    *mem = snap.mem;
+    *lsb = snap.lsb;
+    *rs = snap.rs;
+    *alu = snap.alu;
+    *agu = snap.agu;
+    *iu = snap.iu;
+    *rob = snap.rob;
+    pending = snap.pending;
+}
+
+template <typename Config>
+SimStats Simulator<Config>::Stats() const {
+    SimStats stats;
+    stats.cycles = Clock();
+    stats.instructions = rob->CommitCount();
+    stats.branches = predictor->Total();
+    stats.branch_hits = predictor->Hits();
+    stats.mispredicts = rob->MispredictCount();
+    stats.mispredict_cycles = rob->MispredictCycles();
+    return stats;
+}
+
+template <typename Config>
+void Simulator<Config>::PrintStats(std::ostream &os) const {
+    os << "# machine" << std::endl;
+    desc.Print(os);
+    os << "# stats" << std::endl;
+    auto stats = Stats();
+    os << "cycles = " << stats.cycles << std::endl;
+    os << "instructions = " << stats.instructions << std::endl;
+    os << "ipc = " << stats.Ipc() << std::endl;
+    os << "branches = " << stats.branches << std::endl;
+    os << "branch_hits = " << stats.branch_hits << std::endl;
+    os << "branch_accuracy = " << stats.BranchAccuracy() << std::endl;
+    os << "branch_mpki = " << stats.BranchMpki() << std::endl;
+    os << "mispredicts = " << stats.mispredicts << std::endl;
+    os << "mispredict_penalty = " << stats.MispredictPenalty() << std::endl;
+    if (icache->Enabled()) {
+        iu->PrintStats(os);
+        os << "fetched_bytes_per_instruction = "
+           << (stats.instructions == 0 ? 0.0 : (double)iu->FetchedBytes() / stats.instructions) << std::endl;
+        icache->PrintStats(os, "icache");
+    }
+    cd_bus->PrintStats(os);
+    iu->PrintIssueStats(os);
+    alu->PrintStats(os);
+    agu->PrintStats(os);
+    lsb->PrintStats(os);
+    if (dcache->Enabled()) dcache->PrintStats(os, "dcache");
+    if (l2->Enabled()) l2->PrintStats(os, "l2");
+    if (dram->Enabled()) dram->PrintStats(os);
+    predictor->PrintStats(os);
+    target_predictor->PrintStats(os);
+}
+
+template <typename Config>
+void Simulator<Config>::Flush() {
+    std::swap(cur_state, next_state);
+    // next_state is made again in Execute; till then Clock() is this cycle's
+    next_state->clock = cur_state->clock;
     cur_state->regfile[reName::zero] = {0, -1};
-    if (cur_state->clear) {
-        cd_bus->e.clear();
-        cur_state->wait = false;
-        cur_state->clear_state();
-        for (auto &rg : cur_state->regfile.reg) {
-            rg.recorder = -1;
+    if (cur_state->squash.valid) {
+        for (int i = 0; i < cd_bus->e.size(); ++i) {
+            if (cd_bus->e.busy(i) && cur_state->squash.Squashed(cd_bus->e[i].seq)) {
+                cd_bus->e.clean(i);
+            }
         }
+        cur_state->squash_state();
     }
     // for (int i = 4; i >= 0; --i) {
     //     units[i]->Flush(cur_state);
@@ -72,12 +189,14 @@ void Simulator::Flush() {
     for (auto &unit : units) {
         unit->Flush(cur_state);
     }
-    cd_bus->e.clear();
+    cd_bus->Clear();
 }
 
-void Simulator::Execute() {
-    next_state = new State;
+template <typename Config>
+void Simulator<Config>::Execute() {
+    next_state->reset();
     next_state->enable_debug = enable_debug;
+    next_state->record_commits = cur_state->record_commits;
     next_state->pc = cur_state->pc;
     next_state->clock = cur_state->clock + 1;
     next_state->wait = cur_state->wait;
@@ -85,20 +204,71 @@ void Simulator::Execute() {
     for (auto &unit : units) {
         unit->Execute(cur_state, next_state);
     }
+    cd_bus->Arbitrate();
     // for (int i = 4; i >= 0; --i) {
     //     units[i]->Execute(cur_state, next_state);
     // }
 }
 
 
-void State::clear_state() {
-    ins.first = alu_add_inter.first = alu_camp_inter.first = alu_logic_inter.first = alu_shift_inter.first = false;
-    rs_inter.first = lsb_load_inter.first = lsb_store_inter.first = false;
-    rob_inter.first = false;
-    query_rob_id1 = query_rob_id2 = -1;
+void State::set_squash(SeqType from, AddrType pc, SquashCause cause) {
+    // on a tie the branch / JALR right before a replayed load wins: the load is on its wrong path
+    if (squash.valid && (squash.from < from || (squash.from == from && cause == SquashCause::Replay))) return;
+    squash = Squash{true, from, cause};
+    this->pc = pc;
+    // whatever fetch was waiting for is on the wrong path
+    wait = false;
+}
+
+void State::reset() {
+    // every member back to its default: a new one needs its line here too
+    enable_debug = have_commit = record_commits = false;
+    commits.clear();
+    halt = wait = false;
+    squash = Squash{};
+    ir_valid = true;
+    ins_queue_free = 0;
+    ins.clear();
+    regfile = RegisterFile{};
+    for (auto *inters : {&alu_add_inters, &alu_camp_inters, &alu_logic_inters, &alu_shift_inters, &alu_mul_inters,
+                         &alu_div_inters, &agu_inters}) {
+        inters->clear();
+    }
+    alu_add_free = alu_camp_free = alu_logic_free = alu_shift_free = alu_mul_free = alu_div_free = agu_free = 0;
+    lsb_addrs.clear();
+    rs_inters.clear();
+    rs_alu_add_free = rs_alu_camp_free = rs_alu_logic_free = rs_alu_shift_free = rs_alu_mul_free = rs_alu_div_free =
+        rs_lsb_free = 0;
+    lsb_load_inters.clear();
+    lsb_store_inters.clear();
+    lsb_load_free = lsb_store_free = store_buffer_free = 0;
+    rob_inters.clear();
+    rob_free = rob_tail_pos = 0;
+    rob_data.clear();
+}
+
+void State::squash_state() {
+    // fetched in the last cycle, not issued yet
+    ins.clear();
+    // issued in the last cycle, in program order, so the squashed ones are at the back
+    while (!rob_inters.empty() && squash.Squashed(rob_inters.back().ins.seq)) rob_inters.pop_back();
+    while (!rs_inters.empty() && squash.Squashed(rs_inters.back().ins.seq)) rs_inters.pop_back();
+    while (!lsb_load_inters.empty() && squash.Squashed(lsb_load_inters.back().seq)) lsb_load_inters.pop_back();
+    while (!lsb_store_inters.empty() && squash.Squashed(lsb_store_inters.back().seq)) lsb_store_inters.pop_back();
+    // dispatched from the RS in any order
+    for (auto *inters : {&alu_add_inters, &alu_camp_inters, &alu_logic_inters, &alu_shift_inters, &alu_mul_inters,
+                         &alu_div_inters, &agu_inters}) {
+        inters->erase(std::remove_if(inters->begin(), inters->end(),
+                                     [&](const AluInter &inter) { return squash.Squashed(inter.seq); }),
+                      inters->end());
+    }
+    lsb_addrs.erase(std::remove_if(lsb_addrs.begin(), lsb_addrs.end(),
+                                   [&](const AddrInter &addr) { return squash.Squashed(addr.seq); }),
+                    lsb_addrs.end());
 }
 
-ReturnType Simulator::Run() {
+template <typename Config>
+ReturnType Simulator<Config>::Run() {
     auto rd = std::default_random_engine(std::random_device()());
     
 #ifdef DEBUG
@@ -107,7 +277,7 @@ ReturnType Simulator::Run() {
     }
 #endif
     while (true) {
-        std::shuffle(units, units + 5, rd);
+        std::shuffle(std::begin(units), std::end(units), rd);
         
 #ifdef DEBUG
         if (enable_debug) {
@@ -121,6 +291,9 @@ ReturnType Simulator::Run() {
         if (cur_state->halt) {
             return cur_state->regfile[reName::a0].data & 255U;
         }
+        if (max_clock != -1 && cur_state->clock >= max_clock) {
+            throw std::runtime_error("No halt in " + std::to_string(max_clock) + " cycles");
+        }
         Execute();
 #ifdef DEBUG
         if (enable_debug) {
@@ -134,16 +307,29 @@ ReturnType Simulator::Run() {
 }
 
 
-bool Simulator::Step(DebugRecord &record) {
+template <typename Config>
+bool Simulator<Config>::Step(DebugRecord &record) {
     while (true) {
+        if (!pending.empty()) {
+            record = pending.front();
+            pending.pop_front();
+            return true;
+        }
+        if (next_state->halt) {
+            return false;
+        }
+        if (debug_from_clock != -1 && next_state->clock >= debug_from_clock) {
+            enable_debug = true;
+        }
 #ifdef DEBUG
         if (enable_debug) {
             std::cerr << std::dec <<  "******************* clock " << next_state->clock << " wait: "  << next_state->wait <<
-                      " halt: " << next_state->halt << " clear: " << next_state->clear << " cur_pc:" << std::hex <<
+                      " halt: " << next_state->halt << " squash: " << next_state->squash.valid << " cur_pc:" << std::hex <<
                       next_state->pc << std::dec << std::endl;
             PrintRegFile(std::cerr, &next_state->regfile);
         }
 #endif
+        next_state->record_commits = true;
         Flush();
         Execute();
 #ifdef DEBUG
@@ -151,21 +337,13 @@ bool Simulator::Step(DebugRecord &record) {
             PrintCdBus(std::cerr);
         }
 #endif
-        if (next_state->halt) {
-            return false;
-        }
-        if (next_state->have_commit) {
-            for (int i = 0; i < REG_FILE_SIZE; ++i) {
-                record.reg[i] = next_state->regfile.reg[i].data;
-            }
-            record.ir = next_state->commit_ir;
-            record.pc = next_state->commit_pc;
-            return true;
-        }
+        // the ones before the halt in the same cycle still count
+        pending.insert(pending.end(), next_state->commits.begin(), next_state->commits.end());
     }
 }
 
-void Simulator::PrintRegHelp(std::ostream &os) {
+template <typename Config>
+void Simulator<Config>::PrintRegHelp(std::ostream &os) {
     os << "+**************************************************************************+" << std::endl;
     os << "+  #   + Name + Description           +  #   + Name + Description          +" << std::endl;
     os << "+******+******+***********************+******+******+**********************+" << std::endl;
@@ -188,7 +366,8 @@ void Simulator::PrintRegHelp(std::ostream &os) {
     os << "+**************************************************************************+" << std::endl;
 }
 
-void Simulator::PrintCdBus(std::ostream &os) {
+template <typename Config>
+void Simulator<Config>::PrintCdBus(std::ostream &os) {
     for (auto &it : cd_bus->e) {
         if (it.first) {
             os << std::dec << "BUS >>> Type: " << BusTypeToStr(it.second.type) << " Data: " << it.second.data << " RobPos: "
@@ -198,7 +377,8 @@ void Simulator::PrintCdBus(std::ostream &os) {
     }
 }
 
-void Simulator::PrintRegFile(std::ostream &os, RegisterFile *regfile) {
+template <typename Config>
+void Simulator<Config>::PrintRegFile(std::ostream &os, RegisterFile *regfile) {
     os << "Register File:" << std::endl;
     os << "+-----+----------+-------------+-----+-----+----------+-------------+-----+" << std::endl;
     os << "| Reg |      Hex |         Dec |  #  | Reg |      Hex |         Dec |  #  |" << std::endl;
@@ -217,7 +397,8 @@ void Simulator::PrintRegFile(std::ostream &os, RegisterFile *regfile) {
     os << "+-----+----------+-------------+-----+-----+----------+-------------+-----+" << std::endl;
 }
 
-void Simulator::PrintReg(std::ostream &os, RegisterFile *regfile) {
+template <typename Config>
+void Simulator<Config>::PrintReg(std::ostream &os, RegisterFile *regfile) {
     os << "Register File:" << std::endl;
     os << "+-----+----------+-------------+-----+----------+-------------+" << std::endl;
     os << "| Reg |      Hex |         Dec | Reg |      Hex |         Dec |" << std::endl;
@@ -234,7 +415,8 @@ void Simulator::PrintReg(std::ostream &os, RegisterFile *regfile) {
     os << "+-----+----------+-------------+-----+----------+-------------+" << std::endl;
 }
 
-void Simulator::PrintMem(std::ostream &os, AddrType addr, int len) {
+template <typename Config>
+void Simulator<Config>::PrintMem(std::ostream &os, AddrType addr, int len) {
     os << "Memory:" << std::endl;
     os << "+--------+----------+-------------+" << std::endl;
     os << "|  Addr  |      Hex |         Dec |" << std::endl;
@@ -248,6 +430,28 @@ void Simulator::PrintMem(std::ostream &os, AddrType addr, int len) {
 }
 
 
+
+#define INSTANTIATE_SIMULATOR(Config, name) template class Simulator<Config>;
+FOR_EACH_INSTANTIATED_CONFIG(INSTANTIATE_SIMULATOR)
+#undef INSTANTIATE_SIMULATOR
+
+std::unique_ptr<BaseSimulator> MakeSimulator(const MachineDesc &desc) {
+    desc.Validate();
+#define MAKE_SIMULATOR(Config, name) \
+    if (desc.FitsIn<Config>()) return std::make_unique<Simulator<Config>>(desc);
+    FOR_EACH_MACHINE_CONFIG(MAKE_SIMULATOR)
+#undef MAKE_SIMULATOR
+    return std::make_unique<Simulator<DynamicConfig>>(desc);
+}
+
+std::vector<std::string> MachineConfigNames() {
+    std::vector<std::string> names;
+#define PUSH_NAME(Config, name) names.push_back(name);
+    FOR_EACH_MACHINE_CONFIG(PUSH_NAME)
+#undef PUSH_NAME
+    return names;
+}
+
 }
 
 
@@ -0,0 +1,325 @@
+#include "sweeper.h"
+#include "config/machine_desc.h"
+#include "simulator.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+namespace jasonfxz {
+
+// "1 2 4" or "1..4" (or words, for `predictor`)
+static std::vector<std::string> ParseValues(const std::string &key, const std::string &text) {
+    std::vector<std::string> values;
+    std::istringstream is(text);
+    std::string word;
+    while (is >> word) {
+        auto dots = word.find("..");
+        try {
+            size_t end;
+            if (dots == std::string::npos) {
+                values.push_back(word);
+            } else {
+                int lo = std::stoi(word.substr(0, dots), &end);
+                if (end != dots) throw std::invalid_argument(word);
+                int hi = std::stoi(word.substr(dots + 2), &end);
+                if (end != word.size() - dots - 2 || hi < lo) throw std::invalid_argument(word);
+                for (int v = lo; v <= hi; ++v) values.push_back(std::to_string(v));
+            }
+        } catch (const std::logic_error &) {
+            throw std::runtime_error(key + ": bad value " + word);
+        }
+    }
+    if (values.empty()) throw std::runtime_error(key + ": no value");
+    return values;
+}
+
+void SweepSpec::Load(std::istream &is) {
+    std::string line;
+    int line_no = 0;
+    while (std::getline(is, line)) {
+        ++line_no;
+        auto comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        auto eq = line.find('=');
+        std::istringstream key_ss(line.substr(0, eq));
+        std::string key;
+        if (!(key_ss >> key)) continue; // empty line
+        if (eq == std::string::npos) {
+            throw std::runtime_error("Line " + std::to_string(line_no) + ": expect `key = value`");
+        }
+        std::string value = line.substr(eq + 1);
+        std::istringstream value_ss(value);
+        if (key == "base") {
+            value_ss >> base;
+        } else if (key == "program") {
+            std::string program;
+            while (value_ss >> program) programs.push_back(program);
+        } else if (key == "sample") {
+            value_ss >> sample;
+            if (sample == "random" || sample == "lhs") {
+                if (!(value_ss >> samples) || samples <= 0) {
+                    throw std::runtime_error("sample = " + sample + " needs a positive count");
+                }
+            } else if (sample != "grid") {
+                throw std::runtime_error("Unknown sample method: " + sample);
+            }
+        } else if (key == "seed") {
+            if (!(value_ss >> seed)) throw std::runtime_error("seed needs an integer value");
+        } else if (key == "threads") {
+            if (!(value_ss >> threads)) throw std::runtime_error("threads needs an integer value");
+        } else if (key == "max_cycles") {
+            if (!(value_ss >> max_cycles) || max_cycles <= 0) {
+                throw std::runtime_error("max_cycles needs a positive integer value");
+            }
+        } else if (key == "output") {
+            value_ss >> output;
+        } else {
+            auto values = ParseValues(key, value);
+            MachineDesc desc;
+            for (const auto &v : values) desc.Set(key, v); // throw on unknown key / bad value
+            params.emplace_back(key, values);
+        }
+    }
+    MachineDesc::Named(base);
+    if (programs.empty()) throw std::runtime_error("No program to sweep");
+}
+
+std::vector<SweepPoint> SweepSpec::Points() const {
+    int dims = params.size();
+    long long grid_size = 1;
+    for (const auto &param : params) {
+        grid_size = std::min(grid_size * (long long)param.second.size(), 1LL << 40);
+    }
+    // value indices of each point
+    std::vector<std::vector<int>> picks;
+    std::mt19937 rng(seed);
+    if (sample == "grid" || samples >= grid_size) {
+        std::vector<int> idx(dims, 0);
+        for (long long n = 0; n < grid_size; ++n) {
+            picks.push_back(idx);
+            for (int d = dims - 1; d >= 0; --d) {
+                if (++idx[d] < (int)params[d].second.size()) break;
+                idx[d] = 0;
+            }
+        }
+    } else if (sample == "random") {
+        std::set<std::vector<int>> seen;
+        while ((int)picks.size() < samples) {
+            std::vector<int> idx(dims);
+            for (int d = 0; d < dims; ++d) {
+                idx[d] = std::uniform_int_distribution<int>(0, params[d].second.size() - 1)(rng);
+            }
+            if (seen.insert(idx).second) picks.push_back(idx);
+        }
+    } else { // lhs: each parameter's range is cut into `samples` strata, each used once
+        std::vector<std::vector<int>> strata(dims);
+        for (int d = 0; d < dims; ++d) {
+            strata[d].resize(samples);
+            for (int i = 0; i < samples; ++i) strata[d][i] = i;
+            std::shuffle(strata[d].begin(), strata[d].end(), rng);
+        }
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::set<std::vector<int>> seen;
+        for (int i = 0; i < samples; ++i) {
+            std::vector<int> idx(dims);
+            for (int d = 0; d < dims; ++d) {
+                int len = params[d].second.size();
+                idx[d] = std::min(len - 1, (int)((strata[d][i] + unit(rng)) * len / samples));
+            }
+            // fewer distinct values than samples: some strata collapse to the same point
+            if (seen.insert(idx).second) picks.push_back(idx);
+        }
+    }
+
+    std::vector<SweepPoint> points;
+    for (const auto &idx : picks) {
+        SweepPoint point{{}, MachineDesc::Named(base)};
+        for (int d = 0; d < dims; ++d) {
+            const auto &value = params[d].second[idx[d]];
+            point.values.push_back(value);
+            point.desc.Set(params[d].first, value);
+        }
+        points.push_back(point);
+    }
+    return points;
+}
+
+void ParallelFor(int threads, size_t count, const std::function<void(size_t)> &job) {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex lock;
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < count;) {
+            try {
+                job(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!error) error = std::current_exception();
+                next = count; // hand out no more jobs
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+    for (auto &thread : pool) thread.join();
+    if (error) std::rethrow_exception(error);
+}
+
+Sweeper::Sweeper(const SweepSpec &spec) : spec(spec) {}
+
+std::string Sweeper::Header() const {
+    std::string header;
+    for (const auto &param : spec.params) header += param.first + "\t";
+    return header + "program\tcycles\tinstructions\tipc\tbranch_accuracy\treturn";
+}
+
+std::string Sweeper::Key(const Point &point, const std::string &program) const {
+    std::string key;
+    for (const auto &value : point.values) key += value + "\t";
+    return key + program;
+}
+
+void Sweeper::LoadResults() {
+    std::ifstream is(spec.output);
+    std::string line;
+    if (!is || !std::getline(is, line)) return;
+    if (line != Header()) {
+        throw std::runtime_error(spec.output + " was written by a sweep over other parameters");
+    }
+    int cols = spec.params.size() + 1;
+    while (std::getline(is, line)) {
+        std::istringstream ls(line);
+        std::string key, word;
+        for (int i = 0; i < cols && std::getline(ls, word, '\t'); ++i) {
+            key += (i ? "\t" : "") + word;
+        }
+        Result res;
+        double ipc, accuracy;
+        std::string rest;
+        std::getline(ls, rest);
+        std::istringstream rest_ss(rest);
+        // a row cut short by an interrupted run is simply run again
+        if (rest.compare(0, 7, "failed\t") == 0) {
+            res.error = rest.substr(7);
+            results[key] = res;
+        } else if (rest_ss >> res.stats.cycles >> res.stats.instructions >> ipc >> accuracy >> res.ret) {
+            results[key] = res;
+        }
+    }
+}
+
+void Sweeper::Run(std::ostream &os) {
+    auto points = spec.Points();
+    LoadResults();
+
+    std::vector<std::pair<std::string, std::string>> programs; // path, contents
+    for (const auto &path : spec.programs) {
+        std::ifstream is(path);
+        if (!is) throw std::runtime_error("Failed to open " + path);
+        programs.emplace_back(path, std::string(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()));
+    }
+
+    std::vector<std::pair<const Point *, const std::pair<std::string, std::string> *>> jobs;
+    for (const auto &point : points) {
+        try {
+            point.desc.Validate();
+        } catch (const std::runtime_error &e) {
+            os << "skip " << Key(point, "") << ": " << e.what() << std::endl;
+            continue;
+        }
+        for (const auto &program : programs) {
+            if (!results.count(Key(point, program.first))) jobs.emplace_back(&point, &program);
+        }
+    }
+    os << points.size() << " points x " << programs.size() << " programs, "
+       << jobs.size() << " runs left" << std::endl;
+
+    bool new_file = results.empty();
+    std::ofstream out(spec.output, new_file ? std::ios::out : std::ios::app);
+    if (!out) throw std::runtime_error("Failed to open " + spec.output);
+    if (new_file) out << Header() << std::endl;
+
+    size_t done = 0;
+    std::mutex lock;
+    ParallelFor(spec.threads, jobs.size(), [&](size_t i) {
+        const auto &[point, program] = jobs[i];
+        Result res;
+        try {
+            auto sim = MakeSimulator(point->desc);
+            sim->max_clock = spec.max_cycles;
+            std::istringstream is(program->second);
+            sim->Init(is);
+            res.ret = sim->Run();
+            res.stats = sim->Stats();
+        } catch (const std::exception &e) {
+            res.error = e.what();
+        }
+        auto key = Key(*point, program->first);
+
+        std::lock_guard<std::mutex> guard(lock);
+        results[key] = res;
+        if (!res.error.empty()) {
+            out << key << "\tfailed\t" << res.error << std::endl;
+            os << "[" << ++done << "/" << jobs.size() << "] " << key << " failed: " << res.error << std::endl;
+            return;
+        }
+        out << key << "\t" << res.stats.cycles << "\t" << res.stats.instructions << "\t" << res.stats.Ipc()
+            << "\t" << res.stats.BranchAccuracy() << "\t" << res.ret << std::endl;
+        os << "[" << ++done << "/" << jobs.size() << "] " << key << " ipc " << res.stats.Ipc() << std::endl;
+    });
+
+    PrintParetoFront(os, points);
+}
+
+void Sweeper::PrintParetoFront(std::ostream &os, const std::vector<Point> &points) const {
+    // cost: ROB + the reservation stations + load and store queues + instruction queue
+    // performance: geometric mean IPC over the programs
+    std::vector<std::tuple<int, double, const Point *>> scored;
+    for (const auto &point : points) {
+        double log_sum = 0;
+        bool complete = true;
+        for (const auto &program : spec.programs) {
+            auto it = results.find(Key(point, program));
+            if (it == results.end() || !it->second.error.empty()) {
+                complete = false;
+                break;
+            }
+            log_sum += std::log(it->second.stats.Ipc());
+        }
+        if (!complete) continue;
+        const auto &desc = point.desc;
+        int cost = desc.rob_size + MachineDesc::RS_COUNT * desc.rs_size + 2 * desc.lsb_size + desc.ins_size;
+        scored.emplace_back(cost, std::exp(log_sum / spec.programs.size()), &point);
+    }
+    std::sort(scored.begin(), scored.end(), [](const auto &a, const auto &b) {
+        if (std::get<0>(a) != std::get<0>(b)) return std::get<0>(a) < std::get<0>(b);
+        return std::get<1>(a) > std::get<1>(b);
+    });
+
+    os << "Pareto front (buffer entries vs geomean IPC):" << std::endl;
+    os << "entries\tipc";
+    for (const auto &param : spec.params) os << "\t" << param.first;
+    os << std::endl;
+    double best = -1;
+    for (const auto &[cost, ipc, point] : scored) {
+        if (ipc <= best) continue; // a cheaper point is at least as fast
+        best = ipc;
+        os << cost << "\t" << std::fixed << std::setprecision(4) << ipc << std::defaultfloat;
+        for (const auto &value : point->values) os << "\t" << value;
+        os << std::endl;
+    }
+}
+
+} // namespace jasonfxz
@@ -0,0 +1,79 @@
+#include "units/address_generation_unit.h"
+#include "config/machine_config.h"
+#include "simulator.h"
+#include <algorithm>
+
+namespace jasonfxz {
+
+bool AguCalc::IsStore() const {
+    switch (_.opt) {
+    case SB: case SH: case SW: return true;
+    default: return false;
+    }
+}
+
+bool AguCalc::Calc() {
+    if (cur == 0) return false;
+    if (cur == latency) {
+        res = _.lhs + (IsStore() ? _.imm : _.rhs);
+        return true;
+    }
+    ++cur;
+    return false;
+}
+
+template <typename Config>
+AddressGenerationUnit<Config>::AddressGenerationUnit(CdBus<Config> *cd_bus, const MachineDesc &desc)
+    : calcs(desc.agu_units), cd_bus(cd_bus) {
+    for (auto &calc : calcs) calc.latency = desc.agu_latency;
+}
+
+template <typename Config>
+void AddressGenerationUnit<Config>::Flush(State *cur_state) {
+    if (cur_state->squash.valid) {
+        auto squashed = [&](SeqType seq) { return cur_state->squash.Squashed(seq); };
+        for (auto &calc : calcs) calc.Drop(squashed);
+        held.erase(std::remove_if(held.begin(), held.end(),
+                                  [&](const AluInter &inter) { return squashed(inter.seq); }),
+                   held.end());
+    }
+    ++cycles;
+    for (auto &calc : calcs) {
+        if (calc.ticket != -1) calc.Written(cd_bus->Granted(calc.ticket));
+    }
+    cur_state->agu_free = Accept(calcs, held, cur_state->agu_inters);
+}
+
+template <typename Config>
+void AddressGenerationUnit<Config>::Execute(State *, State *next_state) {
+    for (auto &calc : calcs) {
+        if (!calc.Calc()) continue;
+        // a STORE waiting for the bus has sent its address already
+        if (!calc.stalled) {
+            next_state->lsb_addrs.push_back(AddrInter{calc._.rob_pos, calc._.seq, (AddrType)calc.res});
+            ++addresses;
+        }
+        if (calc.IsStore()) {
+            // mem[rs1(vj) + imm(imm)] <== rs2(vk)
+            calc.ticket = cd_bus->Request(BusProducer::Agu, {BusType::WriteBack, calc._.rhs, calc._.rob_pos, calc._.seq});
+        } else {
+            calc.cur = 0;
+        }
+    }
+}
+
+template <typename Config>
+void AddressGenerationUnit<Config>::PrintStats(std::ostream &os) const {
+    os << "agu_addresses = " << addresses << std::endl;
+    for (size_t i = 0; i < calcs.size(); ++i) {
+        os << "agu" << i << "_busy = " << calcs[i].busy_cycles << std::endl;
+        os << "agu" << i << "_utilization = " << (cycles == 0 ? 0.0 : (double)calcs[i].busy_cycles / cycles)
+           << std::endl;
+    }
+}
+
+#define INSTANTIATE_ADDRESS_GENERATION_UNIT(Config, name) template class AddressGenerationUnit<Config>;
+FOR_EACH_INSTANTIATED_CONFIG(INSTANTIATE_ADDRESS_GENERATION_UNIT)
+#undef INSTANTIATE_ADDRESS_GENERATION_UNIT
+
+} // namespace jasonfxz
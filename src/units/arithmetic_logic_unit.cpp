@@ -1,14 +1,17 @@
 #include "units/arithmetic_logic_unit.h"
+#include "config/machine_config.h"
 #include "config/types.h"
 #include "simulator.h"
+#include <algorithm>
+#include <cstdint>
 #include <stdexcept>
 
 
 namespace jasonfxz {
 
 
-void AddCalc::Calc() {
-    if (cur == 0) return ;
+bool AddCalc::Calc() {
+    if (cur == 0) return false;
     if (cur == latency) {
         switch (_.opt) {
         case ADD: case ADDI: case JALR:
@@ -20,13 +23,14 @@ void AddCalc::Calc() {
         default:
             throw std::runtime_error("Invalid optype in AddCalc");
         }
-    } else {
-        ++cur;
+        return true;
     }
+    ++cur;
+    return false;
 }
 
-void CampCalc::Calc() {
-    if (cur == 0) return ;
+bool CampCalc::Calc() {
+    if (cur == 0) return false;
     if (cur == latency) {
         switch (_.opt) {
         case BEQ:
@@ -50,13 +54,14 @@ void CampCalc::Calc() {
         default:
             throw std::runtime_error("Invalid optype in CampCalc");
         }
-    } else {
-        ++cur;
+        return true;
     }
+    ++cur;
+    return false;
 }
 
-void LogicCalc::Calc() {
-    if (cur == 0) return ;
+bool LogicCalc::Calc() {
+    if (cur == 0) return false;
     if (cur == latency) {
         switch (_.opt) {
         case XOR: case XORI:
@@ -71,13 +76,14 @@ void LogicCalc::Calc() {
         default:
             throw std::runtime_error("Invalid optype in LogicCalc");
         }
-    } else {
-        ++cur;
+        return true;
     }
+    ++cur;
+    return false;
 }
 
-void ShiftCalc::Calc() {
-    if (cur == 0) return ;
+bool ShiftCalc::Calc() {
+    if (cur == 0) return false;
     if (cur == latency) {
         switch (_.opt) {
         case SLL: case SLLI:
@@ -92,95 +98,221 @@ void ShiftCalc::Calc() {
         default:
             throw std::runtime_error("Invalid optype in ShiftCalc");
         }
-    } else {
-        ++cur;
+        return true;
     }
+    ++cur;
+    return false;
 }
 
-void AddCalc::Flush(State *cur_state) {
-    if (cur_state->alu_add_inter.first) {
-        cur = 1;
-        _ = cur_state->alu_add_inter.second;
+bool MulCalc::Calc() {
+    if (stages.empty()) return false;
+    // the first one started is the only one that can be done
+    bool done = stages.front().cur == latency;
+    if (done) {
+        _ = stages.front().inter;
+        int64_t lhs = _.lhs, rhs = _.rhs;
+        uint64_t ulhs = (uint32_t)_.lhs, urhs = (uint32_t)_.rhs;
+        switch (_.opt) {
+        case MUL:
+            res = (uint32_t)(ulhs * urhs);
+            break;
+        case MULH:
+            res = (lhs * rhs) >> 32;
+            break;
+        case MULHSU:
+            res = (lhs * (int64_t)urhs) >> 32;
+            break;
+        case MULHU:
+            res = (ulhs * urhs) >> 32;
+            break;
+        default:
+            throw std::runtime_error("Invalid optype in MulCalc");
+        }
+    }
+    for (auto &stage : stages) {
+        if (stage.cur < latency) ++stage.cur;
     }
-    cur_state->alu_add_busy = (0 < cur && cur < latency); 
+    return done;
 }
 
-void CampCalc::Flush(State *cur_state) {
-    if (cur_state->alu_camp_inter.first) {
-        cur = 1;
-        _ = cur_state->alu_camp_inter.second;
+void MulCalc::Written(bool granted) {
+    if (granted) {
+        stages.pop_front();
+    } else {
+        // nothing has moved up behind it
+        int limit = latency;
+        for (auto &stage : stages) {
+            stage.cur = std::min(stage.cur, limit);
+            limit = stage.cur - 1;
+        }
     }
-    cur_state->alu_camp_busy = (0 < cur && cur < latency);
+    stalled = !granted;
+    ticket = -1;
 }
 
-void LogicCalc::Flush(State *cur_state) {
-    if (cur_state->alu_logic_inter.first) {
-        cur = 1;
-        _ = cur_state->alu_logic_inter.second;
-    }
-    cur_state->alu_logic_busy = (0 < cur && cur < latency);
+void DivCalc::Start(const AluInter &inter) {
+    BaseCalc::Start(inter);
+    bool is_signed = inter.opt == DIV || inter.opt == REM;
+    uint32_t dividend = is_signed && inter.lhs < 0 ? -(uint32_t)inter.lhs : (uint32_t)inter.lhs;
+    int bits = 0;
+    while (bits < 32 && (dividend >> bits) != 0) ++bits;
+    latency = inter.rhs == 0 ? 1 : std::max(1, (max_latency * bits + 31) / 32);
 }
 
-void ShiftCalc::Flush(State *cur_state) {
-    if (cur_state->alu_shift_inter.first) {
-        cur = 1;
-        _ = cur_state->alu_shift_inter.second;
+bool DivCalc::Calc() {
+    if (cur == 0) return false;
+    if (cur == latency) {
+        int32_t lhs = _.lhs, rhs = _.rhs;
+        uint32_t ulhs = _.lhs, urhs = _.rhs;
+        // as the spec says: no trap on a division by zero or an overflow
+        bool overflow = lhs == INT32_MIN && rhs == -1;
+        switch (_.opt) {
+        case DIV:
+            res = rhs == 0 ? -1 : overflow ? lhs : lhs / rhs;
+            break;
+        case DIVU:
+            res = urhs == 0 ? 0xFFFFFFFF : ulhs / urhs;
+            break;
+        case REM:
+            res = rhs == 0 ? lhs : overflow ? 0 : lhs % rhs;
+            break;
+        case REMU:
+            res = urhs == 0 ? ulhs : ulhs % urhs;
+            break;
+        default:
+            throw std::runtime_error("Invalid optype in DivCalc");
+        }
+        return true;
     }
-    cur_state->alu_shift_busy = (0 < cur && cur < latency);
+    ++cur;
+    return false;
 }
 
-
-void ArithmeticLogicUnit::Flush(State *cur_state) {
-    if (cur_state->clear) {
-        addCalc.clear();
-        campCalc.clear();
-        logicCalc.clear();
-        shiftCalc.clear();
+template <typename Config>
+template <typename Calc>
+void ArithmeticLogicUnit<Config>::Retire(std::vector<Calc> &calcs) {
+    for (auto &calc : calcs) {
+        if (calc.ticket != -1) calc.Written(cd_bus->Granted(calc.ticket));
     }
-    addCalc.Flush(cur_state);
-    campCalc.Flush(cur_state);
-    logicCalc.Flush(cur_state);
-    shiftCalc.Flush(cur_state);
 }
 
-void ArithmeticLogicUnit::Execute(State *cur_state, State *next_state) {
-    addCalc.Calc();
-    campCalc.Calc();
-    logicCalc.Calc();
-    shiftCalc.Calc();
-    if (addCalc.cur == addCalc.latency) {
-        if (!cd_bus->e.insert({BusType::WriteBack, addCalc.res, addCalc._.rob_pos})) 
-            throw std::runtime_error("cdBus full");
-        addCalc.cur = 0;
-    }
-    if (campCalc.cur == campCalc.latency) {
-        if (!cd_bus->e.insert({BusType::WriteBack, campCalc.res, campCalc._.rob_pos})) 
-            throw std::runtime_error("cdBus full");
-        campCalc.cur = 0;
-    }
-    if (logicCalc.cur == logicCalc.latency) {
-        if (!cd_bus->e.insert({BusType::WriteBack, logicCalc.res, logicCalc._.rob_pos})) 
-            throw std::runtime_error("cdBus full");
-        logicCalc.cur = 0;
-    }
-    if (shiftCalc.cur == shiftCalc.latency) {
-        if (!cd_bus->e.insert({BusType::WriteBack, shiftCalc.res, shiftCalc._.rob_pos})) 
-            throw std::runtime_error("cdBus full");
-        shiftCalc.cur = 0;
+template <typename Config>
+void ArithmeticLogicUnit<Config>::Flush(State *cur_state) {
+    if (cur_state->squash.valid) {
+        auto squashed = [&](SeqType seq) { return cur_state->squash.Squashed(seq); };
+        auto squash = [&](auto &calcs, std::vector<AluInter> &held) {
+            for (auto &calc : calcs) calc.Drop(squashed);
+            held.erase(std::remove_if(held.begin(), held.end(),
+                                      [&](const AluInter &inter) { return squashed(inter.seq); }),
+                       held.end());
+        };
+        squash(add_calcs, add_held);
+        squash(camp_calcs, camp_held);
+        squash(logic_calcs, logic_held);
+        squash(shift_calcs, shift_held);
+        squash(mul_calcs, mul_held);
+        squash(div_calcs, div_held);
     }
+    ++cycles;
+    Retire(add_calcs);
+    Retire(camp_calcs);
+    Retire(logic_calcs);
+    Retire(shift_calcs);
+    Retire(mul_calcs);
+    Retire(div_calcs);
+    cur_state->alu_add_free = Accept(add_calcs, add_held, cur_state->alu_add_inters);
+    cur_state->alu_camp_free = Accept(camp_calcs, camp_held, cur_state->alu_camp_inters);
+    cur_state->alu_logic_free = Accept(logic_calcs, logic_held, cur_state->alu_logic_inters);
+    cur_state->alu_shift_free = Accept(shift_calcs, shift_held, cur_state->alu_shift_inters);
+    cur_state->alu_mul_free = Accept(mul_calcs, mul_held, cur_state->alu_mul_inters);
+    cur_state->alu_div_free = Accept(div_calcs, div_held, cur_state->alu_div_inters);
 }
 
+template <typename Config>
+void ArithmeticLogicUnit<Config>::Execute(State *, State *next_state) {
+    // the units ask for the bus, the ones that get it are done in the next Flush
+    for (auto &calc : add_calcs) {
+        if (!calc.Calc()) continue;
+        auto type = calc._.opt == JALR ? BusType::JumpTarget : BusType::WriteBack;
+        calc.ticket = cd_bus->Request(BusProducer::AluAdd, {type, calc.res, calc._.rob_pos, calc._.seq});
+    }
+    for (auto &calc : camp_calcs) {
+        if (!calc.Calc()) continue;
+        calc.ticket = cd_bus->Request(BusProducer::AluCamp, {BusType::WriteBack, calc.res, calc._.rob_pos, calc._.seq});
+        if (calc.stalled) continue; // resolved already
+        switch (calc._.opt) {
+        case BEQ: case BNE: case BGE: case BGEU: case BLT: case BLTU:
+            Resolve(calc._, calc.res, next_state);
+            break;
+        default: break;
+        }
+    }
+    for (auto &calc : logic_calcs) {
+        if (!calc.Calc()) continue;
+        calc.ticket = cd_bus->Request(BusProducer::AluLogic, {BusType::WriteBack, calc.res, calc._.rob_pos, calc._.seq});
+    }
+    for (auto &calc : shift_calcs) {
+        if (!calc.Calc()) continue;
+        calc.ticket = cd_bus->Request(BusProducer::AluShift, {BusType::WriteBack, calc.res, calc._.rob_pos, calc._.seq});
+    }
+    for (auto &calc : mul_calcs) {
+        if (!calc.Calc()) continue;
+        calc.ticket = cd_bus->Request(BusProducer::AluMul, {BusType::WriteBack, calc.res, calc._.rob_pos, calc._.seq});
+    }
+    for (auto &calc : div_calcs) {
+        if (!calc.Calc()) continue;
+        calc.ticket = cd_bus->Request(BusProducer::AluDiv, {BusType::WriteBack, calc.res, calc._.rob_pos, calc._.seq});
+    }
+}
 
-ArithmeticLogicUnit::ArithmeticLogicUnit(CdBus *cd_bus) {
-    this->cd_bus = cd_bus;
-    addCalc.latency = 1;
-    campCalc.latency = 1;
-    logicCalc.latency = 1;
-    shiftCalc.latency = 1;
+template <typename Config>
+void ArithmeticLogicUnit<Config>::PrintStats(std::ostream &os) const {
+    auto print = [&](const char *name, const auto &calcs) {
+        for (size_t i = 0; i < calcs.size(); ++i) {
+            os << "alu_" << name << i << "_busy = " << calcs[i].busy_cycles << std::endl;
+            os << "alu_" << name << i << "_utilization = "
+               << (cycles == 0 ? 0.0 : (double)calcs[i].busy_cycles / cycles) << std::endl;
+        }
+    };
+    print("add", add_calcs);
+    print("camp", camp_calcs);
+    print("logic", logic_calcs);
+    print("shift", shift_calcs);
+    print("mul", mul_calcs);
+    for (size_t i = 0; i < mul_calcs.size(); ++i) {
+        os << "alu_mul" << i << "_occupancy = " << (cycles == 0 ? 0.0 : (double)mul_calcs[i].in_flight / cycles)
+           << std::endl;
+    }
+    print("div", div_calcs);
 }
 
 
+template <typename Config>
+void ArithmeticLogicUnit<Config>::Resolve(const AluInter &branch, bool taken, State *next_state) {
+    if (taken == branch.pred) return;
+#ifdef DEBUG
+    if (next_state->enable_debug) {
+        std::cerr << "Predict Failed!!!!" << std::endl;
+    }
+#endif
+    next_state->set_squash(branch.seq + 1, taken ? branch.ins_addr + branch.imm : branch.ins_addr + 4,
+                           SquashCause::Branch);
+}
 
+template <typename Config>
+ArithmeticLogicUnit<Config>::ArithmeticLogicUnit(CdBus<Config> *cd_bus, const MachineDesc &desc)
+    : add_calcs(desc.add_units), camp_calcs(desc.camp_units), logic_calcs(desc.logic_units),
+      shift_calcs(desc.shift_units), mul_calcs(desc.mul_units), div_calcs(desc.div_units), cd_bus(cd_bus) {
+    for (auto &calc : add_calcs) calc.latency = desc.add_latency;
+    for (auto &calc : camp_calcs) calc.latency = desc.camp_latency;
+    for (auto &calc : logic_calcs) calc.latency = desc.logic_latency;
+    for (auto &calc : shift_calcs) calc.latency = desc.shift_latency;
+    for (auto &calc : mul_calcs) calc.latency = desc.mul_latency;
+    for (auto &calc : div_calcs) calc.max_latency = desc.div_latency;
+}
 
+#define INSTANTIATE_ARITHMETIC_LOGIC_UNIT(Config, name) template class ArithmeticLogicUnit<Config>;
+FOR_EACH_INSTANTIATED_CONFIG(INSTANTIATE_ARITHMETIC_LOGIC_UNIT)
+#undef INSTANTIATE_ARITHMETIC_LOGIC_UNIT
 
 } // namespace jasonfxz
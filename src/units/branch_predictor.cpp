@@ -0,0 +1,172 @@
+#include "units/branch_predictor.h"
+#include "config/machine_desc.h"
+#include <stdexcept>
+
+namespace jasonfxz {
+
+static void Train(uint8_t &counter, bool taken) {
+    if (taken) {
+        if (counter < 3) ++counter;
+    } else {
+        if (counter > 0) --counter;
+    }
+}
+
+bool Predictor::GetPrediction(AddrType pc) {
+    bool pred = Predict(pc, spec_history);
+    spec_history = spec_history << 1 | pred;
+    return pred;
+}
+
+void Predictor::GetFeedBack(AddrType pc, bool real, bool pred) {
+    ++count_tot;
+    if (real == pred) ++count_suc;
+    Update(pc, commit_history, real);
+    commit_history = commit_history << 1 | real;
+}
+
+bool BimodalPredictor::Predict(AddrType pc, uint64_t) const {
+    // 0 1 false ; 2 3 true
+    return table[(pc >> 2) & (table.size() - 1)] >= 2;
+}
+
+void BimodalPredictor::Update(AddrType pc, uint64_t, bool taken) {
+    Train(table[(pc >> 2) & (table.size() - 1)], taken);
+}
+
+bool GsharePredictor::Predict(AddrType pc, uint64_t history) const {
+    return table[((pc >> 2) ^ history) & (table.size() - 1)] >= 2;
+}
+
+void GsharePredictor::Update(AddrType pc, uint64_t history, bool taken) {
+    Train(table[((pc >> 2) ^ history) & (table.size() - 1)], taken);
+}
+
+bool TournamentPredictor::Predict(AddrType pc, uint64_t history) const {
+    if (chooser[(pc >> 2) & (chooser.size() - 1)] >= 2) {
+        return gshare.Predict(pc, history);
+    }
+    return bimodal.Predict(pc, history);
+}
+
+void TournamentPredictor::Update(AddrType pc, uint64_t history, bool taken) {
+    auto &choice = chooser[(pc >> 2) & (chooser.size() - 1)];
+    bool bimodal_ok = bimodal.Predict(pc, history) == taken;
+    bool gshare_ok = gshare.Predict(pc, history) == taken;
+    if (choice >= 2) ++chose_gshare;
+    bimodal_hits += bimodal_ok;
+    gshare_hits += gshare_ok;
+    if (bimodal_ok != gshare_ok) Train(choice, gshare_ok);
+    bimodal.Update(pc, history, taken);
+    gshare.Update(pc, history, taken);
+}
+
+void TournamentPredictor::PrintStats(std::ostream &os) const {
+    os << "predictor.chose_gshare = " << chose_gshare << std::endl;
+    os << "predictor.bimodal_hits = " << bimodal_hits << std::endl;
+    os << "predictor.gshare_hits = " << gshare_hits << std::endl;
+}
+
+TagePredictor::TagePredictor(int size) : base(size), index_bits(0) {
+    while ((1 << index_bits) < size) ++index_bits;
+    for (auto &table : tables) table.resize(size);
+}
+
+TagePredictor::Lookup TagePredictor::Find(AddrType pc, uint64_t history) const {
+    Lookup look;
+    uint32_t addr = pc >> 2;
+    for (int i = 0; i < TABLES; ++i) {
+        int len = HISTORY_LENGTH[i];
+        look.index[i] = (addr ^ (addr >> index_bits) ^ Fold(history, len, index_bits)) & ((1U << index_bits) - 1);
+        look.tag[i] = (addr ^ Fold(history, len, TAG_BITS) ^ (Fold(history, len, TAG_BITS - 1) << 1))
+                      & ((1U << TAG_BITS) - 1);
+    }
+    for (int i = TABLES - 1; i >= 0; --i) {
+        const auto &entry = tables[i][look.index[i]];
+        if (!entry.valid || entry.tag != look.tag[i]) continue;
+        if (look.provider == -1) {
+            look.provider = i;
+        } else {
+            look.alt = i;
+            break;
+        }
+    }
+    return look;
+}
+
+bool TagePredictor::PredOf(const Lookup &look, int table, AddrType pc) const {
+    if (table == -1) return base.Predict(pc, 0);
+    return tables[table][look.index[table]].ctr >= 0;
+}
+
+bool TagePredictor::Predict(AddrType pc, uint64_t history) const {
+    auto look = Find(pc, history);
+    return PredOf(look, look.provider, pc);
+}
+
+void TagePredictor::Update(AddrType pc, uint64_t history, bool taken) {
+    auto look = Find(pc, history);
+    bool pred = PredOf(look, look.provider, pc);
+    ++provider_count[look.provider + 1];
+    if (look.provider == -1) {
+        base.Update(pc, history, taken);
+    } else {
+        auto &entry = tables[look.provider][look.index[look.provider]];
+        if (pred != PredOf(look, look.alt, pc)) {
+            if (pred == taken) {
+                if (entry.u < 3) ++entry.u;
+            } else {
+                if (entry.u > 0) --entry.u;
+            }
+        }
+        if (taken) {
+            if (entry.ctr < 3) ++entry.ctr;
+        } else {
+            if (entry.ctr > -4) --entry.ctr;
+        }
+    }
+    // allocate in a longer history table on a misprediction
+    if (pred != taken) {
+        bool allocated = false;
+        for (int i = look.provider + 1; i < TABLES && !allocated; ++i) {
+            auto &entry = tables[i][look.index[i]];
+            if (entry.u == 0) {
+                entry = Entry{true, look.tag[i], int8_t(taken ? 0 : -1), 0};
+                allocated = true;
+            }
+        }
+        if (!allocated) {
+            for (int i = look.provider + 1; i < TABLES; ++i) {
+                auto &entry = tables[i][look.index[i]];
+                if (entry.u > 0) --entry.u;
+            }
+        }
+    }
+    if (++tick == USEFUL_RESET_PERIOD) {
+        tick = 0;
+        for (auto &table : tables) {
+            for (auto &entry : table) entry.u >>= 1;
+        }
+    }
+}
+
+void TagePredictor::PrintStats(std::ostream &os) const {
+    os << "predictor.provider_base = " << provider_count[0] << std::endl;
+    for (int i = 0; i < TABLES; ++i) {
+        os << "predictor.provider_t" << i + 1 << " = " << provider_count[i + 1] << std::endl;
+    }
+}
+
+std::unique_ptr<Predictor> MakePredictor(const MachineDesc &desc) {
+    if (desc.predictor == "bimodal") return std::make_unique<BimodalPredictor>(desc.predictor_size);
+    if (desc.predictor == "gshare") return std::make_unique<GsharePredictor>(desc.predictor_size);
+    if (desc.predictor == "tournament") return std::make_unique<TournamentPredictor>(desc.predictor_size);
+    if (desc.predictor == "tage") return std::make_unique<TagePredictor>(desc.predictor_size);
+    throw std::runtime_error("Unknown predictor: " + desc.predictor);
+}
+
+std::vector<std::string> PredictorNames() {
+    return {"bimodal", "gshare", "tournament", "tage"};
+}
+
+} // namespace jasonfxz
@@ -0,0 +1,224 @@
+#include "units/cache.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace jasonfxz {
+
+ReplacePolicy ReplacePolicyFrom(const std::string &name) {
+    if (name == "lru") return ReplacePolicy::Lru;
+    if (name == "plru") return ReplacePolicy::Plru;
+    if (name == "random") return ReplacePolicy::Random;
+    throw std::runtime_error("Unknown replacement policy: " + name);
+}
+
+Cache::Cache(int size, int assoc, int line, ReplacePolicy policy, int hit_latency, int miss_latency,
+             MemoryLevel *next, int mshrs)
+    : assoc(assoc), policy(policy), hit_latency(hit_latency), miss_latency(miss_latency), next(next), mshrs(mshrs) {
+    if (size == 0) return;
+    sets = size / (assoc * line);
+    while ((1 << line_bits) < line) ++line_bits;
+    lines.resize(sets * assoc);
+    plru.resize(sets * assoc);
+}
+
+void Cache::Touch(int set, int way) {
+    lines[set * assoc + way].last_use = ++tick;
+    // every node on the way down points away from the way just used
+    uint8_t *tree = &plru[set * assoc];
+    int node = 1;
+    for (int half = assoc / 2; half >= 1; half /= 2) {
+        bool right = way & half;
+        tree[node] = !right;
+        node = node * 2 + right;
+    }
+}
+
+int Cache::Victim(int set) {
+    const Line *ways = &lines[set * assoc];
+    for (int way = 0; way < assoc; ++way) {
+        if (!ways[way].valid) return way;
+    }
+    switch (policy) {
+    case ReplacePolicy::Lru: {
+        int victim = 0;
+        for (int way = 1; way < assoc; ++way) {
+            if (ways[way].last_use < ways[victim].last_use) victim = way;
+        }
+        return victim;
+    }
+    case ReplacePolicy::Plru: {
+        const uint8_t *tree = &plru[set * assoc];
+        int node = 1, way = 0;
+        for (int half = assoc / 2; half >= 1; half /= 2) {
+            bool right = tree[node];
+            way |= right ? half : 0;
+            node = node * 2 + right;
+        }
+        return way;
+    }
+    case ReplacePolicy::Random:
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return random_state % assoc;
+    }
+    return 0;
+}
+
+bool Cache::Present(AddrType block) const {
+    int set = block % sets;
+    AddrType tag = block / sets;
+    const Line *ways = &lines[set * assoc];
+    for (int way = 0; way < assoc; ++way) {
+        if (ways[way].valid && ways[way].tag == tag) return true;
+    }
+    return false;
+}
+
+void Cache::Retire(long long now) {
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const Mshr &mshr) { return mshr.ready <= now; }),
+                  pending.end());
+}
+
+bool Cache::Full(AddrType addr, long long now) {
+    Retire(now);
+    if (mshrs == 0 || pending.size() < mshrs || Present(addr >> line_bits)) return false;
+    if (last_full != now) {
+        last_full = now;
+        ++full_cycles;
+    }
+    return true;
+}
+
+void Cache::Tick(long long now) {
+    Retire(now);
+    if (occupancy.size() <= pending.size()) occupancy.resize(pending.size() + 1);
+    ++occupancy[pending.size()];
+}
+
+int Cache::Fill(AddrType block, bool write, bool prefetch, AddrType pc, long long now) {
+    int set = block % sets;
+    Line *ways = &lines[set * assoc];
+    int way = Victim(set);
+    if (ways[way].valid) {
+        AddrType victim = ways[way].tag * sets + set;
+        if (ways[way].dirty) {
+            ++writebacks;
+            if (next != nullptr) next->Access(victim << line_bits, true, pc, now);
+        }
+        if (ways[way].prefetched) {
+            ++prefetch_useless;
+        } else if (prefetch) {
+            ways[way].displaced = true;
+            ways[way].displaced_tag = ways[way].tag;
+        }
+    }
+    for (int other = 0; other < assoc; ++other) {
+        if (ways[other].displaced && ways[other].displaced_tag == block / sets) ways[other].displaced = false;
+    }
+    ways[way].valid = true;
+    ways[way].dirty = write;
+    ways[way].prefetched = prefetch;
+    ways[way].tag = block / sets;
+    Touch(set, way);
+    int latency = next == nullptr ? miss_latency
+                                  : hit_latency + next->Access(block << line_bits, false, pc, now + hit_latency);
+    pending.push_back({block, now + latency});
+    return latency;
+}
+
+void Cache::Prefetch(AddrType addr, AddrType pc, long long now) {
+    AddrType block = addr >> line_bits;
+    if (Present(block)) return;
+    if (mshrs != 0 && pending.size() >= mshrs) {
+        ++prefetch_dropped;
+        return;
+    }
+    ++prefetch_issued;
+    Fill(block, false, true, pc, now);
+}
+
+int Cache::Access(AddrType addr, bool write, AddrType pc, long long now) {
+    Retire(now);
+    AddrType block = addr >> line_bits;
+    int set = block % sets;
+    AddrType tag = block / sets;
+    auto site = sites.find(pc); // only the pcs that have missed are counted
+    if (site != sites.end()) ++site->second.accesses;
+    Line *ways = &lines[set * assoc];
+    bool hit = false;
+    int latency = hit_latency;
+    for (int way = 0; way < assoc; ++way) {
+        if (ways[way].valid && ways[way].tag == tag) {
+            ways[way].dirty |= write;
+            Touch(set, way);
+            ++hits;
+            hit = true;
+            for (const auto &mshr : pending) {
+                if (mshr.block != block) continue;
+                // its line is still on the way
+                ++merges;
+                latency = std::max<long long>(hit_latency, mshr.ready - now);
+            }
+            if (ways[way].prefetched) {
+                ways[way].prefetched = false;
+                ++prefetch_useful;
+                prefetch_late += latency > hit_latency;
+            }
+            break;
+        }
+    }
+    if (!hit) {
+        ++misses;
+        if (site == sites.end()) site = sites.emplace(pc, Site{1, 0}).first;
+        ++site->second.misses;
+        for (int way = 0; way < assoc; ++way) {
+            prefetch_pollution += ways[way].displaced && ways[way].displaced_tag == tag;
+        }
+        latency = Fill(block, write, false, pc, now);
+    }
+    latency_sum += latency;
+    if (prefetcher != nullptr) {
+        prefetches.clear();
+        prefetcher->Observe(pc, addr, hit, prefetches);
+        for (AddrType prefetch : prefetches) Prefetch(prefetch, pc, now);
+    }
+    return latency;
+}
+
+void Cache::PrintStats(std::ostream &os, const std::string &name) const {
+    os << name << "_hits = " << hits << std::endl;
+    os << name << "_misses = " << misses << std::endl;
+    os << name << "_writebacks = " << writebacks << std::endl;
+    os << name << "_miss_rate = " << (hits + misses == 0 ? 0.0 : (double)misses / (hits + misses)) << std::endl;
+    os << name << "_amat = " << (hits + misses == 0 ? 0.0 : (double)latency_sum / (hits + misses)) << std::endl;
+    os << name << "_mshr_merges = " << merges << std::endl;
+    os << name << "_mshr_full_cycles = " << full_cycles << std::endl;
+    for (size_t taken = 0; taken < occupancy.size(); ++taken) {
+        os << name << "_mshr_occupancy." << taken << " = " << occupancy[taken] << std::endl;
+    }
+    if (prefetcher != nullptr) {
+        os << name << "_prefetch_issued = " << prefetch_issued << std::endl;
+        os << name << "_prefetch_dropped = " << prefetch_dropped << std::endl;
+        os << name << "_prefetch_useful = " << prefetch_useful << std::endl;
+        os << name << "_prefetch_late = " << prefetch_late << std::endl;
+        os << name << "_prefetch_useless = " << prefetch_useless << std::endl;
+        os << name << "_prefetch_pollution = " << prefetch_pollution << std::endl;
+        os << name << "_prefetch_accuracy = "
+           << (prefetch_issued == 0 ? 0.0 : (double)prefetch_useful / prefetch_issued) << std::endl;
+        os << name << "_prefetch_coverage = "
+           << (prefetch_useful + misses == 0 ? 0.0 : (double)prefetch_useful / (prefetch_useful + misses)) << std::endl;
+        os << name << "_prefetch_timeliness = "
+           << (prefetch_useful == 0 ? 0.0 : (double)(prefetch_useful - prefetch_late) / prefetch_useful) << std::endl;
+    }
+    for (const auto &[pc, site] : sites) {
+        std::ostringstream key;
+        key << name << "_site." << std::hex << std::setw(8) << std::setfill('0') << pc;
+        os << key.str() << ".accesses = " << site.accesses << std::endl;
+        os << key.str() << ".misses = " << site.misses << std::endl;
+    }
+}
+
+} // namespace jasonfxz
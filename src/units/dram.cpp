@@ -0,0 +1,56 @@
+#include "units/dram.h"
+#include <algorithm>
+
+namespace jasonfxz {
+
+Dram::Dram(int banks, int row_size, int row_hit, int row_miss, int row_conflict, int queue)
+    : banks(banks), row_hit(row_hit), row_miss(row_miss), row_conflict(row_conflict), queue(queue) {
+    while ((1 << row_bits) < row_size) ++row_bits;
+}
+
+int Dram::Access(AddrType addr, bool, AddrType, long long now) {
+    ++accesses;
+    in_flight.erase(std::remove_if(in_flight.begin(), in_flight.end(), [&](long long done) { return done <= now; }),
+                    in_flight.end());
+    long long start = now;
+    if (in_flight.size() >= queue) {
+        auto first = std::min_element(in_flight.begin(), in_flight.end());
+        start = *first;
+        queue_waits += start - now;
+        in_flight.erase(first);
+    }
+    AddrType row = addr >> row_bits;
+    Bank &bank = banks[row % banks.size()];
+    if (bank.free_at > start) {
+        bank_waits += bank.free_at - start;
+        start = bank.free_at;
+    }
+    int latency = row_conflict;
+    if (!bank.open) {
+        latency = row_miss;
+        ++row_misses;
+    } else if (bank.row == row) {
+        latency = row_hit;
+        ++row_hits;
+    } else {
+        ++row_conflicts;
+    }
+    bank.open = true;
+    bank.row = row;
+    bank.free_at = start + latency;
+    in_flight.push_back(bank.free_at);
+    latency_sum += bank.free_at - now;
+    return bank.free_at - now;
+}
+
+void Dram::PrintStats(std::ostream &os) const {
+    os << "dram_accesses = " << accesses << std::endl;
+    os << "dram_row_hits = " << row_hits << std::endl;
+    os << "dram_row_misses = " << row_misses << std::endl;
+    os << "dram_row_conflicts = " << row_conflicts << std::endl;
+    os << "dram_queue_waits = " << queue_waits << std::endl;
+    os << "dram_bank_waits = " << bank_waits << std::endl;
+    os << "dram_amat = " << (accesses == 0 ? 0.0 : (double)latency_sum / accesses) << std::endl;
+}
+
+} // namespace jasonfxz
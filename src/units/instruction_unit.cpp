@@ -1,10 +1,13 @@
 #include "units/instruction_unit.h"
+#include "config/machine_config.h"
 #include "config/types.h"
 #include "simulator.h"
 #include "units/load_store_buffer.h"
 #include "units/reorder_buffer.h"
 #include "units/reservation_station.h"
 #include "utils/utils.h"
+#include <algorithm>
+#include <array>
 #include <iomanip>
 #include <stdexcept>
 // #include <cassert>
@@ -89,6 +92,11 @@ void Decoder::DecodeR(InsType &ins) {
         if (ins.funct7 == 0b000'0000) ins.opt = SLTU;
         break;
     }
+    if (ins.funct7 == 0b000'0001) {
+        // RV32M
+        static constexpr OpType M_OPS[8] = {MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU};
+        ins.opt = M_OPS[ins.funct3];
+    }
     ins.opc = OpClass::ARITHR;
 }
 
@@ -215,19 +223,11 @@ void Decoder::DecodeJ(InsType &ins) {
     }
 }
 
-void InstructionUnit::FetchDecode(State *cur_state, State *next_state) {
-    if (next_state->clear) {
-        return ;
-    }
-    if (cur_state->wait) {
-        return;
-    }
-    if (cur_state->ins_queue_full) {
-        return;
-    }
+template <typename Config>
+bool InstructionUnit<Config>::FetchOne(AddrType pc, DataType ir, int clock, State *next_state) {
     InsType ins;
-    ins.ins_addr = cur_state->pc;
-    ins.ir = cur_state->ir;
+    ins.ins_addr = pc;
+    ins.ir = ir;
     decoder.Decode(ins);
     if (ins.opt == LUI) {
         ins.opc = OpClass::ARITHI;
@@ -241,232 +241,292 @@ void InstructionUnit::FetchDecode(State *cur_state, State *next_state) {
         ins.opt = ADDI;
         ins.rs1 = reName::zero;
         ins.rs2 = -1;
-        ins.imm = cur_state->pc + ins.imm;
+        ins.imm = pc + ins.imm;
     }
+    predictor->Save(ins.checkpoint);
+    target_predictor->Save(ins.checkpoint);
+    bool sequential = false;
     // PC
     if (ins.opc == OpClass::BRANCH) {
-        ins.rd = predictor->GetPrediction(cur_state->pc);
+        ins.fetch_clock = clock;
+        ins.rd = predictor->GetPrediction(pc);
+        target_predictor->Branch(ins.rd);
         // We Just Set rd the expect
         if (ins.rd) {
-            next_state->pc = cur_state->pc + ins.imm;
+            next_state->pc = pc + ins.imm;
         } else {
-            next_state->pc = cur_state->pc + 4;
+            next_state->pc = pc + 4;
+            sequential = true;
         }
     } else if (ins.opt == JAL) {
-        next_state->pc = cur_state->pc + ins.imm;
+        target_predictor->Predict(ins);
+        next_state->pc = pc + ins.imm;
         ins.opc = OpClass::ARITHI;
         ins.opt = ADDI;
         ins.rs1 = reName::zero;
         ins.rs2 = -1;
-        ins.imm = cur_state->pc + 4;
+        ins.imm = pc + 4;
     } else if (ins.opt == JALR) {
-        // Just stop read for next pc
-        // Wait for JALR Commit
-        next_state->wait = true;
+        target_predictor->Predict(ins);
+        if (ins.target_predicted) {
+            next_state->pc = ins.target;
+        } else {
+            // Just stop read for next pc
+            // Wait for JALR Commit
+            next_state->wait = true;
+        }
     } else if (ins.ir == 0x0ff00513) {
         // halt code !!!
         next_state->wait = true;
     } else {
-        next_state->pc = cur_state->pc + 4;
+        next_state->pc = pc + 4;
+        sequential = true;
     }
-    next_state->ins = {true, ins};
+    next_state->ins.push_back(ins);
+    return sequential;
 }
 
+template <typename Config>
+void InstructionUnit<Config>::FetchDecode(State *cur_state, State *next_state) {
+    if (next_state->squash.valid) {
+        return ;
+    }
+    if (cur_state->wait) {
+        return;
+    }
+    if (cur_state->ins_queue_free == 0) {
+        return;
+    }
+    if (!cur_state->ir_valid) {
+        ++empty_cycles;
+        return;
+    }
+    AddrType pc = cur_state->pc;
+    DataType ir = cur_state->ir;
+    int width = std::min(fetch_width, cur_state->ins_queue_free);
+    // a group ends at the first instruction that does not go on to pc + 4
+    for (int fetched = 1; FetchOne(pc, ir, cur_state->clock, next_state) && fetched < width; ++fetched) {
+        pc += 4;
+        // the rest of the group comes out of the fetch buffer too
+        if (icache->Enabled() && !Buffered(pc)) return;
+        ir = mem->ReadWord(pc);
+    }
+}
 
-void InstructionUnit::Execute(State *cur_state, State *next_state) {
+template <typename Config>
+void InstructionUnit<Config>::Execute(State *cur_state, State *next_state) {
     FetchDecode(cur_state, next_state);
     Issue(cur_state, next_state);
 }
 
-void InstructionUnit::Flush(State *cur_state) {
-    if (cur_state->clear) {
+template <typename Config>
+void InstructionUnit<Config>::Flush(State *cur_state) {
+    if (cur_state->squash.valid) {
+        // not issued yet, so younger than anything that can be squashed after
         ins_queue.clear();
-        cur_state->ins_queue_full = ins_queue.full();
+        front_read = false;
     }
     // ins_queue
-    if (cur_state->ins.first) {
+    for (const auto &ins : cur_state->ins) {
         if (ins_queue.full()) {
             throw std::runtime_error("Ins queue is full");
         }
-        ins_queue.push(cur_state->ins.second);
+        ins_queue.push(ins);
     }
-    cur_state->ins_queue_full = ins_queue.full();
-    // 摆烂了 高速内存
+    cur_state->ins_queue_free = ins_queue.cap() - ins_queue.size();
+    if (icache->Enabled()) cur_state->ir_valid = Fetch(cur_state->pc, cur_state->clock);
     cur_state->ir = mem->ReadWord(cur_state->pc);
 }
 
-
-void InstructionUnit::Issue(State *cur_state, State *next_state) {
-    if (ins_queue.empty()) {
-        return;
+template <typename Config>
+bool InstructionUnit<Config>::Fetch(AddrType pc, int clock) {
+    AddrType block = pc & ~AddrType(line - 1);
+    // behind pc, or not on its path at all
+    while (!fetch_blocks.empty() && fetch_blocks.front() != block) fetch_blocks.pop();
+    if (fetch_blocks.empty() && fetching && fetching_block != block) fetching = false;
+    if (fetching && --fetch_left == 0) {
+        fetch_blocks.push(fetching_block);
+        fetching = false;
     }
-    if (cur_state->rob_full) {
-        return;
+    if (!fetching && !fetch_blocks.full()) {
+        fetching_block = fetch_blocks.empty() ? block : fetch_blocks.back() + line;
+        fetch_left = icache->Access(fetching_block, false, fetching_block, clock);
+        fetching = true;
+        fetched_bytes += line;
     }
-    auto &front_ins = ins_queue.front();
-    RobInter rob_inter{front_ins, RobState::Issue, cur_state->rob_tail_pos, front_ins.rd, 0};
-    RsInter rs_inter{front_ins, cur_state->rob_tail_pos};
-    LsbInter lsb_inter{front_ins.opc, front_ins.opt, cur_state->rob_tail_pos};
-    if (front_ins.opc == OpClass::LOAD || front_ins.opc == OpClass::STORE) {
-        // For Load / Store
-        if (front_ins.opc == OpClass::LOAD && cur_state->lsb_load_full) return;
-        if (front_ins.opc == OpClass::STORE && cur_state->lsb_store_full) return;
-        if (cur_state->rs_lsb_full) return;
-        // handle vj (rs1)
-        if (cur_state->regfile[front_ins.rs1].recorder == -1) {
-            // No dependency
-            rs_inter.qj = -1;
-            rs_inter.vj = cur_state->regfile[front_ins.rs1].data;
-        } else {
-            // Wait dependency
-            rs_inter.qj = cur_state->regfile[front_ins.rs1].recorder;
+    return !fetch_blocks.empty() && fetch_blocks.front() == block;
+}
+
+template <typename Config>
+bool InstructionUnit<Config>::Buffered(AddrType pc) {
+    AddrType block = pc & ~AddrType(line - 1);
+    for (AddrType buffered : fetch_blocks) {
+        if (buffered == block) return true;
+    }
+    return false;
+}
+
+template <typename Config>
+void InstructionUnit<Config>::PrintStats(std::ostream &os) const {
+    os << "fetch_empty_cycles = " << empty_cycles << std::endl;
+    os << "fetched_bytes = " << fetched_bytes << std::endl;
+}
+
+template <typename Config>
+void InstructionUnit<Config>::PrintIssueStats(std::ostream &os) const {
+    os << "rob_port_reads = " << port_reads << std::endl;
+    os << "rob_port_stalls = " << port_stalls << std::endl;
+}
+
+
+template <typename Config>
+void InstructionUnit<Config>::Issue(State *cur_state, State *next_state) {
+    // what is left this cycle, less what the instructions before in the group took
+    int rob_free = cur_state->rob_free;
+    int rs_alu_add_free = cur_state->rs_alu_add_free;
+    int rs_alu_camp_free = cur_state->rs_alu_camp_free;
+    int rs_alu_logic_free = cur_state->rs_alu_logic_free;
+    int rs_alu_shift_free = cur_state->rs_alu_shift_free;
+    int rs_alu_mul_free = cur_state->rs_alu_mul_free;
+    int rs_alu_div_free = cur_state->rs_alu_div_free;
+    int rs_lsb_free = cur_state->rs_lsb_free;
+    int lsb_load_free = cur_state->lsb_load_free;
+    int lsb_store_free = cur_state->lsb_store_free;
+    // the renaming the group has left so far, on top of the regfile
+    std::array<int, REG_FILE_SIZE> recorder;
+    for (int i = 0; i < REG_FILE_SIZE; ++i) recorder[i] = cur_state->regfile[i].recorder;
+    int rob_ports = rob_read_ports;
+    // renamed before this group, and written back already: read from the ROB
+    auto in_rob = [&](int reg) {
+        int q = recorder[reg];
+        return q != -1 && q == cur_state->regfile[reg].recorder && cur_state->rob_data[q].first;
+    };
+    auto operand = [&](int reg, int &q, int &v) {
+        q = recorder[reg];
+        if (q == -1) {
+            v = cur_state->regfile[reg].data;
+        } else if (in_rob(reg)) {
+            v = cur_state->rob_data[q].second;
+            q = -1;
         }
-        // handle vk (rs2 / imm)
+    };
+    for (int issued = 0; issued < issue_width && !ins_queue.empty() && rob_free > 0; ++issued) {
+        auto &front_ins = ins_queue.front();
+        int rob_pos = (cur_state->rob_tail_pos + issued) % (rob_size + 1);
+        int *rs_free = nullptr, *queue_free = nullptr;
         if (front_ins.opc == OpClass::LOAD) {
-            // LOAD   rd <== mem[rs1 + imm]
-            rs_inter.vk = front_ins.imm;
-        } else {
-            // STORE mem[rs1 + imm] <== rs2 , vk = rs2
-            if (cur_state->regfile[front_ins.rs2].recorder == -1) {
-                // No dependency
-                rs_inter.qk = -1;
-                rs_inter.vk = cur_state->regfile[front_ins.rs2].data;
-            } else {
-                // Wait dependency
-                rs_inter.qk = cur_state->regfile[front_ins.rs2].recorder;
+            rs_free = &rs_lsb_free, queue_free = &lsb_load_free;
+        } else if (front_ins.opc == OpClass::STORE) {
+            rs_free = &rs_lsb_free, queue_free = &lsb_store_free;
+        } else if (front_ins.opc == OpClass::BRANCH) {
+            rs_free = &rs_alu_camp_free;
+        } else if (front_ins.opc == OpClass::ARITHI || front_ins.opc == OpClass::ARITHR) {
+            switch (front_ins.opt) {
+            case ADD: case ADDI: case SUB:
+                rs_free = &rs_alu_add_free;
+                break;
+            case AND: case ANDI: case OR: case ORI: case XOR: case XORI:
+                rs_free = &rs_alu_logic_free;
+                break;
+            case SLL: case SLLI: case SRL: case SRLI: case SRA: case SRAI:
+                rs_free = &rs_alu_shift_free;
+                break;
+            case SLT: case SLTI: case SLTU: case SLTIU:
+                rs_free = &rs_alu_camp_free;
+                break;
+            case MUL: case MULH: case MULHSU: case MULHU:
+                rs_free = &rs_alu_mul_free;
+                break;
+            case DIV: case DIVU: case REM: case REMU:
+                rs_free = &rs_alu_div_free;
+                break;
+            default:
+                throw std::runtime_error("Unknown opt in Issue ARITHI/ARITHR");
             }
-            rs_inter.imm = front_ins.imm;
+        } else if (front_ins.opt == JALR) {
+            rs_free = &rs_alu_add_free;
+        } else throw std::runtime_error("Unmatch Issue");
+        // in order: the rest of the group waits too
+        if (*rs_free == 0 || (queue_free != nullptr && *queue_free == 0)) break;
+        bool uses_rs2 = front_ins.opc == OpClass::STORE || front_ins.opc == OpClass::BRANCH
+                        || front_ins.opc == OpClass::ARITHR;
+        // rs1 read in an earlier cycle is still there: a written-back entry does not change
+        int reads = (in_rob(front_ins.rs1) && !front_read)
+                    + (uses_rs2 && front_ins.rs2 != front_ins.rs1 && in_rob(front_ins.rs2));
+        if (reads > rob_ports) {
+            ++port_stalls;
+            if (reads == 2 && rob_ports == 1) {
+                // one now, the other in the next cycle
+                front_read = true;
+                --rob_ports;
+                ++port_reads;
+            }
+            break;
         }
-    } else if (front_ins.opc == OpClass::BRANCH) {
-        // For Branch
-        if (cur_state->rs_alu_camp_full) return;
+        rob_ports -= reads;
+        port_reads += reads;
+        front_read = false;
+        --rob_free, --*rs_free;
+        if (queue_free != nullptr) --*queue_free;
+
+        front_ins.seq = next_seq;
+        RobInter rob_inter{front_ins, RobState::Issue, rob_pos, front_ins.rd, 0};
+        if (front_ins.opt == JALR) rob_inter.data = front_ins.ins_addr + 4;
+        RsInter rs_inter{front_ins, rob_pos};
+        LsbInter lsb_inter{front_ins.opc, front_ins.opt, rob_pos};
+        lsb_inter.seq = front_ins.seq;
+        lsb_inter.ins_addr = front_ins.ins_addr;
         // handle vj (rs1)
-        if (cur_state->regfile[front_ins.rs1].recorder == -1) {
-            // No dependency
-            rs_inter.qj = -1;
-            rs_inter.vj = cur_state->regfile[front_ins.rs1].data;
+        operand(front_ins.rs1, rs_inter.qj, rs_inter.vj);
+        if (front_ins.opc == OpClass::LOAD) {
+            // LOAD   rd <== mem[rs1 + imm]
+            rs_inter.vk = front_ins.imm;
+        } else if (front_ins.opc == OpClass::STORE || front_ins.opc == OpClass::BRANCH) {
+            // STORE mem[rs1 + imm] <== rs2 , vk = rs2; BRANCH: imm is the offset
+            operand(front_ins.rs2, rs_inter.qk, rs_inter.vk);
+            rs_inter.imm = front_ins.imm;
+        } else if (front_ins.opc == OpClass::ARITHR) {
+            operand(front_ins.rs2, rs_inter.qk, rs_inter.vk);
         } else {
-            // Wait dependency
-            rs_inter.qj = cur_state->regfile[front_ins.rs1].recorder;
-        }
-        // handle vk (rs2)
-        if (cur_state->regfile[front_ins.rs2].recorder == -1) {
-            // No dependency
+            // ARITHI, JALR: vk = imm
             rs_inter.qk = -1;
-            rs_inter.vk = cur_state->regfile[front_ins.rs2].data;
-        } else {
-            // Wait dependency
-            rs_inter.qk = cur_state->regfile[front_ins.rs2].recorder;
+            rs_inter.vk = front_ins.imm;
         }
-        // Set imm(offset)
-        rs_inter.imm = front_ins.imm;
-    } else if (front_ins.opc == OpClass::ARITHI || front_ins.opc == OpClass::ARITHR) {
-        switch (front_ins.opt) {
-        case ADD: case ADDI: case SUB:
-            if (cur_state->rs_alu_add_full) return;
-            break;
-        case AND: case ANDI: case OR: case ORI: case XOR: case XORI:
-            if (cur_state->rs_alu_logic_full) return;
-            break;
-        case SLL: case SLLI: case SRL: case SRLI: case SRA: case SRAI:
-            if (cur_state->rs_alu_shift_full) return;
-            break;
-        case SLT: case SLTI: case SLTU: case SLTIU:
-            if (cur_state->rs_alu_camp_full) return;
-            break;
-        default:
-            throw std::runtime_error("Unknown opt in Issue ARITHI/ARITHR");
+        // Change Regfile
+        if ((front_ins.opc == OpClass::ARITHI || front_ins.opc == OpClass::ARITHR
+             || front_ins.opc == OpClass::LOAD || front_ins.opt == JALR) && front_ins.rd != reName::zero) {
+            rob_inter.old_recorder = recorder[front_ins.rd];
+            recorder[front_ins.rd] = rob_pos;
+            next_state->regfile[front_ins.rd].recorder = rob_pos;
         }
-        // handle vj (rs1)
-        if (cur_state->regfile[front_ins.rs1].recorder == -1) {
-            // No dependency
-            rs_inter.qj = -1;
-            rs_inter.vj = cur_state->regfile[front_ins.rs1].data;
+        // send to Rs
+        if (front_ins.ir != 0x0ff00513) {
+            next_state->rs_inters.push_back(rs_inter);
         } else {
-            // Wait dependency
-            rs_inter.qj = cur_state->regfile[front_ins.rs1].recorder;
+            rob_inter.state = RobState::Write;
         }
-        // handle vk (rs2 / imm)
-        if (front_ins.opc == OpClass::ARITHI) {
-            rs_inter.qk = -1;
-            rs_inter.vk = front_ins.imm;
-        } else {
-            if (cur_state->regfile[front_ins.rs2].recorder == -1) {
-                // No dependency
-                rs_inter.qk = -1;
-                rs_inter.vk = cur_state->regfile[front_ins.rs2].data;
-            } else {
-                // Wait dependency
-                rs_inter.qk = cur_state->regfile[front_ins.rs2].recorder;
-            }
+        // send to ROB
+        next_state->rob_inters.push_back(rob_inter);
+        // send to LSB
+        if (front_ins.opc == OpClass::LOAD) {
+            next_state->lsb_load_inters.push_back(lsb_inter);
         }
-    } else if (front_ins.opt == JALR) {
-        // rd = PC + 4
-        // PC = (rs1 + imm) data
-        if (cur_state->rs_alu_add_full) return;
-        // handle vj (rs1)
-        if (cur_state->regfile[front_ins.rs1].recorder == -1) {
-            // No dependency
-            rs_inter.qj = -1;
-            rs_inter.vj = cur_state->regfile[front_ins.rs1].data;
-        } else {
-            // Wait dependency
-            rs_inter.qj = cur_state->regfile[front_ins.rs1].recorder;
+        if (front_ins.opc == OpClass::STORE) {
+            next_state->lsb_store_inters.push_back(lsb_inter);
         }
-        // handle vk (imm)
-        rs_inter.qk = -1;
-        rs_inter.vk = front_ins.imm;
-    } else throw std::runtime_error("Unmatch Issue");
-    // Change Regfile
-    if (front_ins.opc == OpClass::ARITHI || front_ins.opc == OpClass::ARITHR
-    || front_ins.opc == OpClass::LOAD || front_ins.opt == JALR) {
-        next_state->regfile[front_ins.rd].recorder = cur_state->rob_tail_pos;
-    }
-    next_state->query_rob_id1 = rs_inter.qj;
-    next_state->query_rob_id2 = rs_inter.qk;
-    // send to Rs
-    if (front_ins.ir != 0x0ff00513) {
-        next_state->rs_inter = {true, rs_inter};
-    } else {
-        rob_inter.state = RobState::Write;
-    }
-    // send to ROB
-    next_state->rob_inter = {true, rob_inter};
-    // send to LSB
-    if (front_ins.opc == OpClass::LOAD) {
-        next_state->lsb_load_inter = {true, lsb_inter};
-    }
-    if (front_ins.opc == OpClass::STORE) {
-        next_state->lsb_store_inter = {true, lsb_inter};
-    }
-    ins_queue.pop();
 #ifdef DEBUG
-    if (cur_state->enable_debug) {
-        std::cerr << "Issue >>> " << front_ins << std::endl;
-        std::cerr << "> RsInter: " << rs_inter << std::endl;
-    }
-#endif
-}
-
-bool Predictor::GetPrediction(AddrType pc) {
-    int hash = pc & 0b11111;
-    // 0 1 false ; 2 3 true
-    return table[hash] >= 2;
-}
-
-void Predictor::GetFeedBack(AddrType pc, bool real, bool pred) {
-    ++count_tot;
-    if (real == pred) ++count_suc;
-    int hash = pc & 0b11111;
-    if (real) {
-        if (table[hash] < 3) {
-            ++table[hash];
-        }
-    } else {
-        if (table[hash] > 0) {
-            --table[hash];
+        if (cur_state->enable_debug) {
+            std::cerr << "Issue >>> " << front_ins << std::endl;
+            std::cerr << "> RsInter: " << rs_inter << std::endl;
         }
+#endif
+        ins_queue.pop();
+        ++next_seq;
     }
 }
 
+#define INSTANTIATE_INSTRUCTION_UNIT(Config, name) template class InstructionUnit<Config>;
+FOR_EACH_INSTANTIATED_CONFIG(INSTANTIATE_INSTRUCTION_UNIT)
+#undef INSTANTIATE_INSTRUCTION_UNIT
+
 } // namespace jasonfxz
\ No newline at end of file
@@ -1,132 +1,317 @@
 #include "units/load_store_buffer.h"
+#include "config/machine_config.h"
 #include "circuits/bus.h"
 #include "config/types.h"
 #include "config/constant.h"
 #include "simulator.h"
+#include "utils/utils.h"
 #include <cassert>
-#include <climits>
+#include <ostream>
 #include <stdexcept>
 
 namespace jasonfxz {
 
 
 
-void LoadStoreBuffer::Flush(State *cur_state) {
-    if (cur_state->clear) {
-        load_queue.clear();
-        // the storing should have be done
-        store_queue.clear();
-        assert(store_counter == 0);
-        load_counter = store_counter = 0;
-        cur_state->lsb_load_full = load_queue.full();
-        cur_state->lsb_store_full = store_queue.full();
+static int Width(OpType opt) {
+    switch (opt) {
+    case LB: case LBU: case SB: return 1;
+    case LH: case LHU: case SH: return 2;
+    default: return 4;
     }
-    if (cur_state->lsb_load_inter.first) {
-        if (!load_queue.push({cur_state->clock, cur_state->lsb_load_inter.second})) {
-            throw std::runtime_error("Load queue full");
+}
+
+static bool Overlap(const LsbInter &a, const LsbInter &b) {
+    return a.addr < b.addr + Width(b.opt) && b.addr < a.addr + Width(a.opt);
+}
+
+static bool Covers(const LsbInter &store, const LsbInter &load) {
+    return store.addr <= load.addr && load.addr + Width(load.opt) <= store.addr + Width(store.opt);
+}
+
+// what the load would read once the store is written
+static DataType Forward(const LsbInter &store, const LsbInter &load) {
+    DataType bytes = (DataType)store.data >> 8 * (load.addr - store.addr);
+    switch (load.opt) {
+    case LB: return SEXT((ByteType)bytes);
+    case LH: return SEXT((HalfType)bytes);
+    case LW: return bytes;
+    case LBU: return ZEXT((ByteType)bytes);
+    case LHU: return ZEXT((HalfType)bytes);
+    default: throw std::runtime_error("Invalid load type");
+    }
+}
+
+template <typename Config>
+void LoadStoreBuffer<Config>::Flush(State *cur_state) {
+    if (cur_state->squash.valid) {
+        // in program order, so the squashed ones are at the back
+        while (!load_queue.empty() && cur_state->squash.Squashed(load_queue.back().seq)) {
+            load_queue.pop_back();
+        }
+        // uncommitted, so none of them is being stored
+        while (!store_queue.empty() && cur_state->squash.Squashed(store_queue.back().seq)) {
+            store_queue.pop_back();
+        }
+    }
+    // StoreSetPredictor sees them in program order, the loads and the stores of a cycle interleaved
+    auto load = cur_state->lsb_load_inters.begin(), store = cur_state->lsb_store_inters.begin();
+    while (load != cur_state->lsb_load_inters.end() || store != cur_state->lsb_store_inters.end()) {
+        if (store == cur_state->lsb_store_inters.end()
+            || (load != cur_state->lsb_load_inters.end() && load->seq < store->seq)) {
+            auto inter = *load++;
+            inter.wait_for = store_sets.Load(inter.ins_addr);
+            if (!load_queue.push(inter)) {
+                throw std::runtime_error("Load queue full");
+            }
+        } else {
+            auto inter = *store++;
+            inter.store_set = store_sets.Store(inter.ins_addr, inter.seq);
+            if (!store_queue.push(inter)) {
+                throw std::runtime_error("Store queue full");
+            }
         }
     }
-    if (cur_state->lsb_store_inter.first) {
-        if (!store_queue.push({cur_state->clock, cur_state->lsb_store_inter.second})) {
-            throw std::runtime_error("Store queue full");
+    Granted();
+    // Set the free entries
+    cur_state->lsb_load_free = load_queue.cap() - load_queue.size();
+    cur_state->lsb_store_free = store_queue.cap() - store_queue.size();
+    // Load and Store addresses from the AGUs
+    for (const auto &info : cur_state->lsb_addrs) {
+        for (auto &it : load_queue) {
+            if (it.rob_pos == info.rob_pos) {
+                it.addr_ready = 1;
+                it.addr = info.addr;
+            }
+        }
+        int index = 0;
+        for (auto &it : store_queue) {
+            // a committed store has left the ROB, its rob_pos may be someone else's now
+            if (index++ >= committed && it.rob_pos == info.rob_pos) {
+                it.addr_ready = 1;
+                it.addr = info.addr;
+                store_sets.Resolve(it.store_set, it.seq);
+                CheckOrder(it);
+            }
         }
     }
-    // Set the full flag
-    cur_state->lsb_load_full = load_queue.full();
-    cur_state->lsb_store_full = store_queue.full();
     // CD BUS
     for (const auto &it : cd_bus->e) if (it.first) {
             const auto &info = it.second;
-            if (info.type == BusType::GetAddr) {
-                // Check CDB for Load and Store address
-                for (auto &it : load_queue) {
-                    if (it.second.rob_pos == info.pos) {
-                        it.second.addr_ready = 1;
-                        it.second.addr = info.data;
-                    }
-                }
+            if (info.type == BusType::WriteBack) {
+                // the data of a store, for the loads after it
+                int index = 0;
                 for (auto &it : store_queue) {
-                    if (it.second.rob_pos == info.pos) {
-                        it.second.addr_ready = 1;
-                        it.second.addr = info.data;
+                    if (index++ >= committed && it.rob_pos == info.pos) {
+                        it.data_ready = true;
+                        it.data = info.data;
                     }
                 }
+            } else if (info.type == BusType::CommitReg) {
+                if (!load_queue.empty() && load_queue.front().rob_pos == info.pos) load_queue.pop();
             } else if (info.type == BusType::CommitMem) {
-                // Store commit (Give the data)
-                assert(info.pos == store_queue.front().second.rob_pos);
-                assert(store_queue.front().second.addr_ready);
-                store_enable = true;
-                store_data = info.data; // Get Data (the data to store)
+                // Store commit (Give the data): the oldest store not committed yet
+                int index = 0;
+                for (auto &store : store_queue) {
+                    if (index++ < committed) continue;
+                    assert(info.pos == store.rob_pos);
+                    assert(store.addr_ready);
+                    store.data = info.data;
+                    store.data_ready = true;
+                    ++committed;
+                    break;
+                }
             }
         }
-    if (store_queue.empty()) {
-        load_enable_level = INT_MAX;
-    } else {
-        load_enable_level = store_queue.front().first;
+    cur_state->store_buffer_free = store_buffer - committed;
+}
+
+template <typename Config>
+void LoadStoreBuffer<Config>::Granted() {
+    for (auto &load : load_queue) {
+        if (load.ticket == -1) continue;
+        load.written = cd_bus->Granted(load.ticket);
+        bus_stalls += !load.written;
+        load.ticket = -1;
+    }
+    if (store_ticket != -1) {
+        if (cd_bus->Granted(store_ticket)) {
+            Drain();
+        } else {
+            ++bus_stalls;
+        }
+        store_ticket = -1;
     }
 }
 
+template <typename Config>
+void LoadStoreBuffer<Config>::Drain() {
+    for (; draining > 0; --draining, --committed) {
+        const auto &store = store_queue.front();
+        switch (store.opt) {
+        case SB: mem->WriteByte(store.addr, store.data); break;
+        case SH: mem->WriteHalf(store.addr, store.data); break;
+        case SW: mem->WriteWord(store.addr, store.data); break;
+        default: throw std::runtime_error("Invalid store type");
+        }
+        store_queue.pop();
+        ++drained;
+    }
+    ++drains;
+}
 
-void LoadStoreBuffer::Execute(State *cur_state, State *next_state) {
-    if (load_counter == 0) { // load is available
-        // Load
-        if (!load_queue.empty()) {
-            auto &front = load_queue.front();
-            if (front.second.addr_ready && front.first <= load_enable_level) {
-                // Loading
-                load_counter = 1;
-            }
+template <typename Config>
+void LoadStoreBuffer<Config>::CheckOrder(const LsbInter &store) {
+    for (auto &load : load_queue) {
+        if (load.held && load.wait_for == store.seq && Overlap(load, store)) ++avoided;
+    }
+    // oldest first; a load that took its data from a younger store got the right one
+    for (auto &load : load_queue) {
+        if (load.seq < store.seq || !load.issued || load.source > store.seq || !Overlap(load, store)) continue;
+        if (!replay.first || load.seq < replay.second.seq) replay = {true, load};
+        store_sets.Violation(load.ins_addr, store.ins_addr);
+        break;
+    }
+}
+
+template <typename Config>
+bool LoadStoreBuffer<Config>::StartLoad(LsbInter &load, int clock) {
+    for (auto &store : store_queue) {
+        if (store.seq == load.wait_for && !store.addr_ready) {
+            waits += !load.held;
+            load.held = true;
+            return false;
+        }
+    }
+    LsbInter *source = nullptr;
+    bool unknown = false; // a store after source whose address is unknown
+    for (auto &store : store_queue) {
+        if (store.seq > load.seq) break;
+        if (!store.addr_ready) {
+            unknown = true;
+        } else if (Overlap(store, load)) {
+            source = &store;
+            unknown = false;
         }
+    }
+    if (source != nullptr) {
+        // only part of the bytes: wait until it is written
+        if (!Covers(*source, load) || !source->data_ready) return false;
+        load.data = Forward(*source, load);
+        load.data_ready = true;
+        load.source = source->seq;
+        ++forwards;
+        load.latency = 1;
     } else {
-        if (load_counter == load_latency) {
-            // Load
-            auto &front = load_queue.front();
-            BusInter bus_inter;
-            bus_inter.type = BusType::WriteBack;
-            bus_inter.pos = front.second.rob_pos;
-            switch (front.second.opt) {
-            case LB: bus_inter.data = mem->ReadByte(front.second.addr); break;
-            case LH: bus_inter.data = mem->ReadHalf(front.second.addr); break;
-            case LW: bus_inter.data = mem->ReadWord(front.second.addr); break;
-            case LBU: bus_inter.data = mem->ReadByteU(front.second.addr); break;
-            case LHU: bus_inter.data = mem->ReadHalfU(front.second.addr); break;
+        // a miss with no MSHR free, the next cycle may have one
+        if (dcache->Enabled() && dcache->Full(load.addr, clock)) return false;
+        load.source = -1;
+        load.latency = dcache->Enabled() ? dcache->Access(load.addr, false, load.ins_addr, clock) : load_latency;
+    }
+    load.counter = 1;
+    speculative += unknown;
+    load.issued = true;
+    return true;
+}
+
+template <typename Config>
+void LoadStoreBuffer<Config>::ExecuteLoads(int clock) {
+    // the loads in flight
+    int outstanding = 0;
+    for (auto &load : load_queue) {
+        if (!load.issued || load.written) continue;
+        if (load.counter < load.latency) {
+            ++load.counter;
+            ++outstanding;
+            continue;
+        }
+        if (!load.data_ready) {
+            switch (load.opt) {
+            case LB: load.data = mem->ReadByte(load.addr); break;
+            case LH: load.data = mem->ReadHalf(load.addr); break;
+            case LW: load.data = mem->ReadWord(load.addr); break;
+            case LBU: load.data = mem->ReadByteU(load.addr); break;
+            case LHU: load.data = mem->ReadHalfU(load.addr); break;
             default: throw std::runtime_error("Invalid load type");
             }
-            load_queue.pop();
-            if (!cd_bus->e.insert(bus_inter)) {
-                throw std::runtime_error("Cd bus full");
-            }
-            load_counter = 0;
-        } else {
-            load_counter++;
+            load.data_ready = true;
         }
+        // in flight until it gets the bus
+        load.ticket = cd_bus->Request(BusProducer::Load, BusInter{BusType::WriteBack, (int)load.data, load.rob_pos, load.seq});
+        ++outstanding;
     }
-    if (store_counter == 0) { // store is available
-        // Store
-        if (store_enable) {
-            // Storing
-            store_counter = 1;
-            store_enable = false;
+    // then the ready ones, in any order of their addresses, oldest first
+    int port = 0;
+    for (auto &load : load_queue) {
+        if (port == load_ports || outstanding == max_outstanding) break;
+        if (load.issued || !load.addr_ready) continue;
+        if (StartLoad(load, clock)) {
+            ++port_busy[port++];
+            ++outstanding;
         }
-    } else {
-        if (store_counter == store_latency) {
-            // Store
-            switch (store_queue.front().second.opt) {
-            case SB: mem->WriteByte(store_queue.front().second.addr, store_data); break;
-            case SH: mem->WriteHalf(store_queue.front().second.addr, store_data); break;
-            case SW: mem->WriteWord(store_queue.front().second.addr, store_data); break;
-            default: throw std::runtime_error("Invalid store type");
-            }
-            BusInter bus_inter{BusType::StoreSuccess, 0, store_queue.front().second.rob_pos};
-            if (!cd_bus->e.insert(bus_inter)) {
-                throw std::runtime_error("Cd bus full");
+    }
+}
+
+template <typename Config>
+void LoadStoreBuffer<Config>::Execute(State *cur_state, State *next_state) {
+    ++cycles;
+    if (dcache->Enabled()) dcache->Tick(cur_state->clock);
+    if (replay.first) {
+        next_state->set_squash(replay.second.seq, replay.second.ins_addr, SquashCause::Replay);
+        ++violations;
+        replay.first = false;
+    }
+    buffered += committed;
+    if (draining == 0) {
+        // the oldest committed store, and with a store buffer the ones right after it in the same line
+        if (committed > 0 && !(dcache->Enabled() && dcache->Full(store_queue.front().addr, cur_state->clock))) {
+            const auto &store = store_queue.front();
+            draining = 1;
+            if (store_buffer > 0) {
+                for (const auto &next : store_queue) {
+                    if (&next == &store) continue;
+                    if (draining == committed || next.addr / line != store.addr / line) break;
+                    ++draining;
+                }
             }
-            store_queue.pop();
-            store_counter = 0;
+            coalesced += draining - 1;
+            store_wait = dcache->Enabled() ? dcache->Access(store.addr, true, store.ins_addr, cur_state->clock) : store_latency;
+            store_counter = 1;
+        }
+    } else if (store_counter == store_wait) {
+        // without a store buffer the ROB is waiting for it, it is written once the bus tells it
+        if (store_buffer > 0) {
+            Drain();
         } else {
-            store_counter++;
+            store_ticket = cd_bus->Request(BusProducer::Store, BusInter{BusType::StoreSuccess, 0, store_queue.front().rob_pos});
         }
+    } else {
+        store_counter++;
     }
+    ExecuteLoads(cur_state->clock);
 }
 
+template <typename Config>
+void LoadStoreBuffer<Config>::PrintStats(std::ostream &os) const {
+    os << "load_forwards = " << forwards << std::endl;
+    os << "load_speculative = " << speculative << std::endl;
+    os << "load_violations = " << violations << std::endl;
+    os << "load_waits = " << waits << std::endl;
+    os << "load_violations_avoided = " << avoided << std::endl;
+    os << "lsb_bus_stalls = " << bus_stalls << std::endl;
+    os << "stores_drained = " << drained << std::endl;
+    os << "store_drains = " << drains << std::endl;
+    os << "stores_coalesced = " << coalesced << std::endl;
+    os << "store_drain_rate = " << (cycles == 0 ? 0.0 : (double)drained / cycles) << std::endl;
+    os << "store_buffer_occupancy = " << (cycles == 0 ? 0.0 : (double)buffered / cycles) << std::endl;
+    for (int i = 0; i < load_ports; ++i) {
+        os << "load_port" << i << "_busy = " << port_busy[i] << std::endl;
+        os << "load_port" << i << "_utilization = " << (cycles == 0 ? 0.0 : (double)port_busy[i] / cycles) << std::endl;
+    }
+}
+
+#define INSTANTIATE_LOAD_STORE_BUFFER(Config, name) template class LoadStoreBuffer<Config>;
+FOR_EACH_INSTANTIATED_CONFIG(INSTANTIATE_LOAD_STORE_BUFFER)
+#undef INSTANTIATE_LOAD_STORE_BUFFER
+
 } // namespace jasonfxz
\ No newline at end of file
@@ -22,16 +22,16 @@ ByteType &Memory::operator[](AddrType addr) {
     return data[addr];
 }
 
-ByteType Memory::ReadByte(AddrType addr) {
+DataType Memory::ReadByte(AddrType addr) {
     return SEXT(data[addr]);
 }
-ByteType Memory::ReadByteU(AddrType addr) {
+DataType Memory::ReadByteU(AddrType addr) {
     return ZEXT(data[addr]);
 }
-HalfType Memory::ReadHalf(AddrType addr) {
+DataType Memory::ReadHalf(AddrType addr) {
     return SEXT(Concat(data[addr], data[addr + 1]));
 }
-HalfType Memory::ReadHalfU(AddrType addr) {
+DataType Memory::ReadHalfU(AddrType addr) {
     return ZEXT(Concat(data[addr], data[addr + 1]));
 }
 DataType Memory::ReadWord(AddrType addr) {
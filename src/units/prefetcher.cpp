@@ -0,0 +1,74 @@
+#include "units/prefetcher.h"
+#include "config/machine_desc.h"
+#include <stdexcept>
+
+namespace jasonfxz {
+
+void NextLinePrefetcher::Observe(AddrType, AddrType addr, bool hit, std::vector<AddrType> &prefetches) {
+    if (hit) return;
+    AddrType block = addr & ~AddrType(line - 1);
+    for (int i = 1; i <= degree; ++i) prefetches.push_back(block + i * line);
+}
+
+void StridePrefetcher::Observe(AddrType pc, AddrType addr, bool, std::vector<AddrType> &prefetches) {
+    Entry &entry = table[(pc >> 2) & (table.size() - 1)];
+    if (!entry.valid || entry.pc != pc) {
+        entry = Entry{true, pc, addr, 0, 0};
+        return;
+    }
+    int32_t stride = addr - entry.last;
+    entry.last = addr;
+    if (stride == entry.stride) {
+        if (entry.confidence < 3) ++entry.confidence;
+    } else if (entry.confidence > 0) {
+        --entry.confidence;
+    } else {
+        entry.stride = stride;
+    }
+    if (entry.confidence < 2 || entry.stride == 0) return;
+    for (int i = 1; i <= degree; ++i) prefetches.push_back(addr + i * entry.stride);
+}
+
+void StreamPrefetcher::Ahead(AddrType block, std::vector<AddrType> &prefetches) const {
+    for (int i = 1; i <= degree; ++i) prefetches.push_back((block + i) * line);
+}
+
+void StreamPrefetcher::Observe(AddrType, AddrType addr, bool hit, std::vector<AddrType> &prefetches) {
+    AddrType block = addr / line;
+    ++tick;
+    for (auto &stream : streams) {
+        if (stream.valid && stream.next <= block && block < stream.next + degree) {
+            stream.next = block + 1;
+            stream.last_use = tick;
+            Ahead(block, prefetches);
+            return;
+        }
+    }
+    if (hit) return;
+    Stream *victim = &streams[0];
+    for (auto &stream : streams) {
+        if (!stream.valid) {
+            victim = &stream;
+            break;
+        }
+        if (stream.last_use < victim->last_use) victim = &stream;
+    }
+    *victim = Stream{true, block + 1, tick};
+    Ahead(block, prefetches);
+}
+
+std::unique_ptr<Prefetcher> MakePrefetcher(const MachineDesc &desc) {
+    if (desc.prefetcher == "none") return nullptr;
+    if (desc.prefetcher == "next_line") return std::make_unique<NextLinePrefetcher>(desc.dcache_line, desc.prefetch_degree);
+    if (desc.prefetcher == "stride") return std::make_unique<StridePrefetcher>(desc.prefetch_table, desc.prefetch_degree);
+    if (desc.prefetcher == "stream") {
+        return std::make_unique<StreamPrefetcher>(desc.dcache_line, desc.prefetch_streams, desc.prefetch_degree);
+    }
+    throw std::runtime_error("Unknown prefetcher: " + desc.prefetcher);
+}
+
+std::vector<std::string> PrefetcherNames() {
+    return {"none", "next_line", "stride", "stream"};
+}
+
+} // namespace jasonfxz
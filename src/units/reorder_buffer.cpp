@@ -3,6 +3,8 @@
 #include "units/base_unit.h"
 #include "utils/utils.h"
 #include "units/reorder_buffer.h"
+#include "units/target_predictor.h"
+#include "config/machine_config.h"
 #include "simulator.h"
 #include <cassert>
 #include <stdexcept>
@@ -13,7 +15,8 @@
 namespace jasonfxz {
 // class
 
-void ReorderBuffer::Print() {
+template <typename Config>
+void ReorderBuffer<Config>::Print() {
     std::cerr << ">>> ROB " << rob_queue.size()  << std::endl;
     for (const auto &it : rob_queue) {
         std::cerr << "> " << std::setw(4) << std::setfill('0') << std::hex << it.ins.ins_addr << " "
@@ -24,16 +27,81 @@ void ReorderBuffer::Print() {
     }
 }
 
-void ReorderBuffer::Flush(State *cur_state) {
-    if (cur_state->clear) {
-        rob_queue.clear();
-        cur_state->rob_full = rob_queue.full();
-        cur_state->rob_tail_pos = rob_queue.tail();
+template <typename Config>
+void ReorderBuffer<Config>::Squash(State *cur_state) {
+    const auto &squash = cur_state->squash;
+    PredictorCheckpoint replayed; // of the oldest one dropped
+    while (!rob_queue.empty() && squash.Squashed(rob_queue.back().ins.seq)) {
+        replayed = rob_queue.back().ins.checkpoint;
+        rob_data[rob_queue.back().rob_pos].first = false;
+        rob_queue.pop_back();
+    }
+    switch (squash.cause) {
+    case SquashCause::Branch: {
+        // resolved in the last cycle, so it has not committed yet
+        assert(!rob_queue.empty() && rob_queue.back().ins.seq == squash.from - 1);
+        const auto &branch = rob_queue.back().ins;
+        bool taken = !branch.rd; // the prediction was wrong
+        predictor->Restore(branch.checkpoint, taken);
+        target_predictor->Restore(branch.checkpoint, taken);
+        // the instructions the checkpoint waits for are older; those committed since have their data in
+        const auto &checkpoint = checkpoints[rob_queue.back().rob_pos];
+        for (int i = 0; i < REG_FILE_SIZE; ++i) {
+            int recorder = checkpoint[i];
+            cur_state->regfile[i].recorder = recorder != -1 && rob_queue.busy(recorder) ? recorder : -1;
+        }
+        ++mispredict_count;
+        mispredict_cycles += cur_state->clock - branch.fetch_clock;
+        break;
+    }
+    case SquashCause::Jalr:
+        // committed already: the committed predictor state is the right one
+        predictor->Recover();
+        target_predictor->Recover();
+        WalkRenaming(cur_state);
+        break;
+    case SquashCause::Replay:
+        // the load is fetched again, with the predictor state it was fetched with
+        predictor->Restore(replayed);
+        target_predictor->Restore(replayed);
+        WalkRenaming(cur_state);
+        break;
+    }
+}
+
+template <typename Config>
+void ReorderBuffer<Config>::WalkRenaming(State *cur_state) {
+    for (auto &reg : cur_state->regfile.reg) reg.recorder = -1;
+    // oldest to youngest, so the last writer of a register wins, as at issue
+    for (const auto &entry : rob_queue) {
+        const auto &ins = entry.ins;
+        if (ins.opc == OpClass::ARITHI || ins.opc == OpClass::ARITHR || ins.opc == OpClass::LOAD || ins.opt == JALR) {
+            cur_state->regfile[entry.dest].recorder = entry.rob_pos;
+        }
+    }
+    cur_state->regfile[reName::zero].recorder = -1;
+}
+
+template <typename Config>
+void ReorderBuffer<Config>::Flush(State *cur_state) {
+    if (cur_state->squash.valid) {
+        Squash(cur_state);
     }
     // handle issue
-    if (cur_state->rob_inter.first) {
+    const auto &inters = cur_state->rob_inters;
+    for (size_t i = 0; i < inters.size(); ++i) {
         if (rob_queue.full()) throw std::runtime_error("ROB is full");
-        rob_queue.push(cur_state->rob_inter.second);
+        const auto &inter = inters[i];
+        if (inter.ins.opc == OpClass::BRANCH) {
+            // the regfile has the renaming of the whole group: take back the ones issued after the branch
+            auto &checkpoint = checkpoints[inter.rob_pos];
+            for (int r = 0; r < REG_FILE_SIZE; ++r) checkpoint[r] = cur_state->regfile[r].recorder;
+            for (size_t j = inters.size() - 1; j > i; --j) {
+                if (inters[j].old_recorder != RobInter::NO_RENAME) checkpoint[inters[j].dest] = inters[j].old_recorder;
+            }
+        }
+        rob_queue.push(inter);
+        rob_data[inter.rob_pos] = {inter.state == RobState::Write, inter.data};
     }
     // lookup CdBus
     for (const auto &it : cd_bus->e) if (it.first) {
@@ -42,10 +110,16 @@ void ReorderBuffer::Flush(State *cur_state) {
             case BusType::WriteBack:
                 rob_queue[info.pos].state = RobState::Write;
                 rob_queue[info.pos].data = info.data;
+                rob_data[info.pos] = {true, info.data};
                 break;
             // case BusType::Executing:
             //     rob_queue[info.pos].state = RobState::Exec;
             //     break;
+            case BusType::JumpTarget:
+                rob_queue[info.pos].state = RobState::Write;
+                rob_queue[info.pos].target = info.data;
+                rob_data[info.pos] = {true, rob_queue[info.pos].data};
+                break;
             case BusType::StoreSuccess:
                 assert(info.pos == rob_queue.front().rob_pos);
                 StoreSuccessFlag = true;
@@ -53,8 +127,9 @@ void ReorderBuffer::Flush(State *cur_state) {
             default: break;
             };
         }
-    cur_state->rob_full = rob_queue.full();
+    cur_state->rob_free = rob_queue.cap() - rob_queue.size();
     cur_state->rob_tail_pos = rob_queue.tail();
+    cur_state->rob_data = rob_data;
 #ifdef DEBUG
     if (cur_state->enable_debug) {
         Print();
@@ -62,56 +137,69 @@ void ReorderBuffer::Flush(State *cur_state) {
 #endif
 }
 
-void ReorderBuffer::Commit(State *cur_state, State *next_state) {
-    if (rob_queue.empty()) return ;
+template <typename Config>
+bool ReorderBuffer<Config>::CommitFront(State *next_state, int &store_buffer_free) {
+    if (rob_queue.empty()) return false;
     auto &front = rob_queue.front();
-    if (front.state != RobState::Write && front.state != RobState::WaitSt) return;
+    if (front.state != RobState::Write && front.state != RobState::WaitSt) return false;
     bool commit_flag = true;
     if (front.ins.opc == OpClass::STORE) {
         commit_flag = false;
         if (front.state == RobState::WaitSt && StoreSuccessFlag) {
             commit_flag = true;
         }
+        if (store_buffer && front.state == RobState::Write) {
+            if (store_buffer_free == 0) return false;
+            --store_buffer_free;
+            commit_flag = true;
+        }
     }
+    const InsType ins = front.ins;
     if (commit_flag) {
 #ifdef DEBUG
-        if (cur_state->enable_debug) {
+        if (next_state->enable_debug) {
             std::cout << "Commit>>>";
             front.ins.Print(std::cout);
         }
 #endif
-        // for Step
         next_state->have_commit = true;
-        next_state->commit_pc = front.ins.ins_addr;
-        next_state->commit_ir = front.ins.GetIR();
+        ++commit_count;
     }
+    bool go_on = true; // the next one may commit in this cycle too
+    // committed, or a store waiting for StoreSuccess: no data for Issue any more
+    rob_data[front.rob_pos].first = false;
     if (front.ins.opt == ADDI && front.ins.rd == reName::a0 && front.ins.rs1 == 0 && front.ins.imm == 255) {
         next_state->halt = true;
-        return ;
+        return false;
     } else if (front.ins.opt == JALR) {
         // handle JALR
         next_state->regfile[front.ins.rd].data = front.ins.ins_addr + 4;
         if (next_state->regfile[front.ins.rd].recorder == front.rob_pos) {
             next_state->regfile[front.ins.rd].recorder = -1;
         }
-        next_state->pc = front.data;
-        assert(next_state->pc % 4 == 0);
-        next_state->wait = false;
-        cd_bus->e.insert(BusInter{BusType::CommitReg,  int(front.ins.ins_addr + 4), front.rob_pos});
-        rob_queue.pop();
-    } else if (front.ins.opc == OpClass::BRANCH) {
-        predictor->GetFeedBack(front.ins.ins_addr, front.data, front.ins.rd);
-        if (front.ins.rd != front.data) {
-            // Predicted Failed
+        target_predictor->Commit(front.ins, front.target);
+        if (!front.ins.target_predicted) {
+            // fetch has been waiting for us
+            next_state->pc = front.target;
+            next_state->wait = false;
+        } else if (front.ins.target != front.target) {
+            // Predicted target Failed
 #ifdef DEBUG
-            if (cur_state->enable_debug) {
-                std::cerr << "Predict Failed!!!!" << std::endl;
+            if (next_state->enable_debug) {
+                std::cerr << "Predict Target Failed!!!!" << std::endl;
             }
 #endif
-            next_state->clear = true;
-            next_state->pc = front.data ? front.ins.ins_addr + front.ins.imm : front.ins.ins_addr + 4; // By Address Unit
-            assert(next_state->pc % 4 == 0);
+            next_state->set_squash(front.ins.seq + 1, front.target, SquashCause::Jalr);
+            go_on = false;
         }
+        assert(front.target % 4 == 0);
+        if (cd_bus->e.full()) throw std::runtime_error("CdBus Full");
+        cd_bus->e.insert(BusInter{BusType::CommitReg,  int(front.ins.ins_addr + 4), front.rob_pos});
+        rob_queue.pop();
+    } else if (front.ins.opc == OpClass::BRANCH) {
+        // a misprediction has been taken care of by the ALU already
+        predictor->GetFeedBack(front.ins.ins_addr, front.data, front.ins.rd);
+        target_predictor->CommitBranch(front.data);
         rob_queue.pop();
     } else if (front.ins.opc == OpClass::ARITHI || front.ins.opc == OpClass::ARITHR
                || front.ins.opc == OpClass::LOAD) {
@@ -119,6 +207,7 @@ void ReorderBuffer::Commit(State *cur_state, State *next_state) {
         // Modify NextCycle Reg
         // Why base on next_state?
         // Becasue the Issue will also modify the regfile !!!
+        if (front.ins.ras_push) target_predictor->Commit(front.ins, 0); // JAL
         next_state->regfile[front.dest].data = front.data;
         if (next_state->regfile[front.dest].recorder == front.rob_pos) {
             next_state->regfile[front.dest].recorder = -1;
@@ -130,10 +219,16 @@ void ReorderBuffer::Commit(State *cur_state, State *next_state) {
             if (cd_bus->e.full()) throw std::runtime_error("CdBus Full");
             cd_bus->e.insert(BusInter{BusType::CommitMem, front.data, front.rob_pos});
             front.state = RobState::WaitSt;
+            if (store_buffer) rob_queue.pop();
+            // a load behind it that read memory too early is replayed by the LSB in
+            // the next cycle: it must not commit in this one
+            go_on = false;
         } else if (front.state == RobState::WaitSt) {
             if (StoreSuccessFlag) {
                 StoreSuccessFlag = 0;
                 rob_queue.pop();
+            } else {
+                go_on = false;
             }
         } else throw std::runtime_error("WTF STORE?");
         // Wait for Store Success in Flush
@@ -141,23 +236,29 @@ void ReorderBuffer::Commit(State *cur_state, State *next_state) {
         std::cerr << "FUCK commit" << front.ins.opt << std::endl;
         throw std::runtime_error("Unmatch Commit");
     }
+    if (commit_flag && next_state->record_commits) {
+        // for Step: the registers right after this one
+        DebugRecord record;
+        record.pc = ins.ins_addr;
+        record.ir = ins.GetIR();
+        for (int i = 0; i < REG_FILE_SIZE; ++i) record.reg[i] = next_state->regfile.reg[i].data;
+        next_state->commits.push_back(record);
+    }
+    // x0 reads 0 again for the next one, as after Flush
+    next_state->regfile[reName::zero].data = 0;
+    return go_on;
 }
 
-void ReorderBuffer::Execute(State *cur_state, State *next_state) {
-    // LookUp query_rob
-    if (cur_state->query_rob_id1 != -1 && rob_queue.busy(cur_state->query_rob_id1)
-        && rob_queue[cur_state->query_rob_id1].state == RobState::Write) {
-        next_state->query_rob_id1_data = {cur_state->query_rob_id1, rob_queue[cur_state->query_rob_id1].data};
-    } else {
-        next_state->query_rob_id1_data.first = -1;
+template <typename Config>
+void ReorderBuffer<Config>::Execute(State *cur_state, State *next_state) {
+    int store_buffer_free = cur_state->store_buffer_free;
+    for (int i = 0; i < commit_width; ++i) {
+        if (!CommitFront(next_state, store_buffer_free)) break;
     }
-    if (cur_state->query_rob_id2 != -1 && rob_queue.busy(cur_state->query_rob_id2)
-        && rob_queue[cur_state->query_rob_id2].state == RobState::Write) {
-        next_state->query_rob_id2_data = {cur_state->query_rob_id2, rob_queue[cur_state->query_rob_id2].data};
-    } else {
-        next_state->query_rob_id2_data.first = -1;
-    }
-    Commit(cur_state, next_state);
 }
 
+#define INSTANTIATE_REORDER_BUFFER(Config, name) template class ReorderBuffer<Config>;
+FOR_EACH_INSTANTIATED_CONFIG(INSTANTIATE_REORDER_BUFFER)
+#undef INSTANTIATE_REORDER_BUFFER
+
 } // namespace jasonfxz
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "units/reservation_station.h"
+#include "config/machine_config.h"
 #include "circuits/bus.h"
 #include "config/constant.h"
 #include "config/types.h"
@@ -6,13 +7,16 @@
 #include "units/arithmetic_logic_unit.h"
 #include "units/load_store_buffer.h"
 #include "utils/utils.h"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <cstring>
+#include <functional>
 
 namespace jasonfxz {
 
-void ReservationStation::Print() {
+template <typename Config>
+void ReservationStation<Config>::Print() {
     std::cerr << ">>> ALU_ADD_RS: " << alu_add_rs.count() << std::endl;
     for (int i = 0; i < alu_add_rs.size(); i++) {
         if (alu_add_rs.busy(i)) {
@@ -41,6 +45,20 @@ void ReservationStation::Print() {
                       alu_shift_rs[i].vk << " qj:" << alu_shift_rs[i].qj << " qk:" << alu_shift_rs[i].qk << std::endl;
         }
     }
+    std::cerr << ">>> ALU_MUL_RS: " << alu_mul_rs.count() << std::endl;
+    for (int i = 0; i < alu_mul_rs.size(); i++) {
+        if (alu_mul_rs.busy(i)) {
+            std::cerr << "#" << i << ": " << OpcodeToStr(alu_mul_rs[i].ins.opt) << " vj:" << alu_mul_rs[i].vj << " vk:" <<
+                      alu_mul_rs[i].vk << " qj:" << alu_mul_rs[i].qj << " qk:" << alu_mul_rs[i].qk << std::endl;
+        }
+    }
+    std::cerr << ">>> ALU_DIV_RS: " << alu_div_rs.count() << std::endl;
+    for (int i = 0; i < alu_div_rs.size(); i++) {
+        if (alu_div_rs.busy(i)) {
+            std::cerr << "#" << i << ": " << OpcodeToStr(alu_div_rs[i].ins.opt) << " vj:" << alu_div_rs[i].vj << " vk:" <<
+                      alu_div_rs[i].vk << " qj:" << alu_div_rs[i].qj << " qk:" << alu_div_rs[i].qk << std::endl;
+        }
+    }
     std::cerr << ">>> LSB_RS: " << lsb_rs.count() << std::endl;
     for (int i = 0; i < lsb_rs.size(); i++) {
         if (lsb_rs.busy(i)) {
@@ -51,90 +69,99 @@ void ReservationStation::Print() {
 }
 
 
-void ReservationStation::Flush(State *cur_state) {
-    if (cur_state->clear) {
-        for (int i = 0; i < 5; ++i) {
-            rss[i].clear();
+template <typename Config>
+void ReservationStation<Config>::Flush(State *cur_state) {
+    if (cur_state->squash.valid) {
+        for (auto &rs : rss) {
+            for (int i = rs.size() - 1; i >= 0; --i) {
+                if (rs.busy(i) && cur_state->squash.Squashed(rs[i].ins.seq)) rs.remove(i);
+            }
         }
     }
-    if (cur_state->rs_inter.first) {
-        if (cur_state->rs_inter.second.ins.opc == OpClass::LOAD
-            || cur_state->rs_inter.second.ins.opc == OpClass::STORE) {
+    for (const auto &inter : cur_state->rs_inters) {
+        if (inter.ins.opc == OpClass::LOAD || inter.ins.opc == OpClass::STORE) {
             // Load or Store
-            if (!lsb_rs.insert(cur_state->rs_inter.second)) {
+            if (!lsb_rs.insert(inter)) {
                 throw std::runtime_error("LS_RS full");
             }
         } else {
             // ALU
-            switch (cur_state->rs_inter.second.ins.opt) {
+            switch (inter.ins.opt) {
             case ADD: case SUB: case ADDI: case JALR:
-                if (!alu_add_rs.insert(cur_state->rs_inter.second)) {
+                if (!alu_add_rs.insert(inter)) {
                     throw std::runtime_error("ALU_ADD_RS full");
                 }
                 break;
             case SLT: case SLTU: case SLTI: case SLTIU: case BEQ: case BNE: case BGE: case BGEU: case BLT: case BLTU:
-                if (!alu_camp_rs.insert(cur_state->rs_inter.second)) {
+                if (!alu_camp_rs.insert(inter)) {
                     throw std::runtime_error("ALU_CAMP_RS full");
                 }
                 break;
             case XOR: case OR: case AND:
             case XORI: case ORI: case ANDI:
-                if (!alu_logic_rs.insert(cur_state->rs_inter.second)) {
+                if (!alu_logic_rs.insert(inter)) {
                     throw std::runtime_error("ALU_LOGIC_RS full");
                 }
                 break;
             case SLL: case SRL: case SRA:
             case SLLI: case SRLI: case SRAI:
-                if (!alu_shift_rs.insert(cur_state->rs_inter.second)) {
+                if (!alu_shift_rs.insert(inter)) {
                     throw std::runtime_error("ALU_SHIFT_RS full");
                 }
                 break;
+            case MUL: case MULH: case MULHSU: case MULHU:
+                if (!alu_mul_rs.insert(inter)) {
+                    throw std::runtime_error("ALU_MUL_RS full");
+                }
+                break;
+            case DIV: case DIVU: case REM: case REMU:
+                if (!alu_div_rs.insert(inter)) {
+                    throw std::runtime_error("ALU_DIV_RS full");
+                }
+                break;
             default:
-                // std::cerr << cur_state->rs_inter.second.ins.opt << std::endl;
                 throw std::runtime_error("Unknown op class");
             }
         }
     }
-    // Set the full flag
-    cur_state->rs_alu_add_full = alu_add_rs.full();
-    cur_state->rs_alu_camp_full = alu_camp_rs.full();
-    cur_state->rs_alu_logic_full = alu_logic_rs.full();
-    cur_state->rs_alu_shift_full = alu_shift_rs.full();
-    cur_state->rs_lsb_full = lsb_rs.full();
+    // Set the free entries
+    cur_state->rs_alu_add_free = alu_add_rs.size() - alu_add_rs.count();
+    cur_state->rs_alu_camp_free = alu_camp_rs.size() - alu_camp_rs.count();
+    cur_state->rs_alu_logic_free = alu_logic_rs.size() - alu_logic_rs.count();
+    cur_state->rs_alu_shift_free = alu_shift_rs.size() - alu_shift_rs.count();
+    cur_state->rs_alu_mul_free = alu_mul_rs.size() - alu_mul_rs.count();
+    cur_state->rs_alu_div_free = alu_div_rs.size() - alu_div_rs.count();
+    cur_state->rs_lsb_free = lsb_rs.size() - lsb_rs.count();
     // Update Qj, Qk
-    pair<bool, int> update[MAX_ROB_SIZE + 1];
-    for (int i = 0; i < MAX_ROB_SIZE; ++i) {
-        update[i] = {false, 0};
-    }
-    // Data From CdBUS
+    // Data From CdBUS; `update` is all false between cycles
+    bool updated = false;
     for (const auto &it : cd_bus->e) if (it.first) {
             const auto &info = it.second;
             if (info.type == BusType::WriteBack || info.type == BusType::CommitReg) {
                 update[info.pos] = {true, info.data};
+                updated = true;
             }
         }
-    // Data From ROB Query
-    if (cur_state->query_rob_id1_data.first != -1) {
-        update[cur_state->query_rob_id1_data.first] = {true, cur_state->query_rob_id1_data.second};
-    }
-    if (cur_state->query_rob_id2_data.first != -1) {
-        update[cur_state->query_rob_id2_data.first] = {true, cur_state->query_rob_id2_data.second};
-    }
-    // Check each Qj,Qk
-    for (auto &rs : rss) {
-        for (auto &jt : rs) {
-            if (jt.first) {
-                if (jt.second.qj != -1 && update[jt.second.qj].first) {
-                    jt.second.vj = update[jt.second.qj].second;
-                    jt.second.qj = -1;
+    if (updated) {
+        // Check each Qj,Qk; remove() keeps the entries at the front
+        for (auto &rs : rss) {
+            for (int i = 0; i < rs.count(); ++i) {
+                auto &entry = rs[i];
+                if (entry.qj != -1 && update[entry.qj].first) {
+                    entry.vj = update[entry.qj].second;
+                    entry.qj = -1;
                 }
-                if (jt.second.qk != -1 && update[jt.second.qk].first) {
-                    // std::cerr << " fuck get qk " << std::endl;
-                    jt.second.vk = update[jt.second.qk].second;
-                    jt.second.qk = -1;
+                if (entry.qk != -1 && update[entry.qk].first) {
+                    entry.vk = update[entry.qk].second;
+                    entry.qk = -1;
                 }
             }
         }
+        for (const auto &it : cd_bus->e) {
+            if (it.first && (it.second.type == BusType::WriteBack || it.second.type == BusType::CommitReg)) {
+                update[it.second.pos].first = false;
+            }
+        }
     }
 #ifdef DEBUG
     if (cur_state->enable_debug) {
@@ -143,121 +170,60 @@ void ReservationStation::Flush(State *cur_state) {
 #endif
 }
 
-void ReservationStation::Execute(State *cur_state, State *next_state) {
+template <typename Config>
+void ReservationStation<Config>::Execute(State *cur_state, State *next_state) {
     ExecuteALU(cur_state, next_state);
     ExecuteLSB(cur_state, next_state);
 }
 
-void ReservationStation::ExecuteALU(State *cur_state, State *next_state) {
-    // ALU_ADD
-    if (!cur_state->alu_add_busy)
-        for (int i = 0; i < alu_add_rs.size(); i++) {
-            if (alu_add_rs.busy(i)) {
-                alu_add_rs.count();
-                if (alu_add_rs[i].qj == -1 && alu_add_rs[i].qk == -1) {
-                    next_state->alu_add_inter.first = true;
-                    next_state->alu_add_inter.second = AluInter{
-                        alu_add_rs[i].vj,
-                        alu_add_rs[i].vk,
-                        alu_add_rs[i].rob_pos,
-                        alu_add_rs[i].ins.opt
-                    };
-                    alu_add_rs.remove(i);
-                    break;
-                }
-            }
-        }
-    // ALU_CAMP
-    if (!cur_state->alu_camp_busy)
-        for (int i = 0; i < alu_camp_rs.size(); i++) {
-            if (alu_camp_rs.busy(i)) {
-                if (alu_camp_rs[i].qj == -1 && alu_camp_rs[i].qk == -1) {
-                    next_state->alu_camp_inter.first = true;
-                    next_state->alu_camp_inter.second = AluInter{
-                        alu_camp_rs[i].vj,
-                        alu_camp_rs[i].vk,
-                        alu_camp_rs[i].rob_pos,
-                        alu_camp_rs[i].ins.opt
-                    };
-                    alu_camp_rs.remove(i);
-                    break;
-                }
-            }
-        }
-    // ALU_LOGIC
-    if (!cur_state->alu_logic_busy)
-        for (int i = 0; i < alu_logic_rs.size(); i++) {
-            if (alu_logic_rs.busy(i)) {
-                if (alu_logic_rs[i].qj == -1 && alu_logic_rs[i].qk == -1) {
-                    next_state->alu_logic_inter.first = true;
-                    next_state->alu_logic_inter.second = AluInter{
-                        alu_logic_rs[i].vj,
-                        alu_logic_rs[i].vk,
-                        alu_logic_rs[i].rob_pos,
-                        alu_logic_rs[i].ins.opt
-                    };
-                    alu_logic_rs.remove(i);
-                    break;
-                }
-            }
-        }
-    // ALU_SHIFT
-    if (!cur_state->alu_shift_busy)
-        for (int i = 0; i < alu_shift_rs.size(); i++) {
-            if (alu_shift_rs.busy(i)) {
-                if (alu_shift_rs[i].qj == -1 && alu_shift_rs[i].qk == -1) {
-                    next_state->alu_shift_inter.first = true;
-                    next_state->alu_shift_inter.second = AluInter{
-                        alu_shift_rs[i].vj,
-                        alu_shift_rs[i].vk,
-                        alu_shift_rs[i].rob_pos,
-                        alu_shift_rs[i].ins.opt
-                    };
-                    alu_shift_rs.remove(i);
-                    break;
-                }
-            }
-        }
+template <typename Config>
+void ReservationStation<Config>::Select(Carray<RsInter, Config::MAX_RS_SIZE> &rs, int width,
+                                        std::vector<AluInter> &inters) {
+    ready.clear();
+    for (int i = 0; i < rs.count(); i++) {
+        if (rs[i].qj == -1 && rs[i].qk == -1) ready.push_back(i);
+    }
+    // oldest first: seq grows in program order, as the ROB does
+    size_t count = std::min<size_t>(width, ready.size());
+    if (count == 0) return;
+    std::partial_sort(ready.begin(), ready.begin() + count, ready.end(),
+                      [&](int a, int b) { return rs[a].ins.seq < rs[b].ins.seq; });
+    for (size_t i = 0; i < count; ++i) {
+        const auto &entry = rs[ready[i]];
+        inters.push_back(AluInter{
+            entry.vj,
+            entry.vk,
+            entry.rob_pos,
+            entry.ins.seq,
+            entry.ins.opt,
+            entry.ins.rd != 0, // the predicted direction, for a BRANCH
+            entry.ins.ins_addr,
+            entry.imm
+        });
+    }
+    // remove() moves the entries after it down, so the highest index goes first
+    if (count > 1) std::sort(ready.begin(), ready.begin() + count, std::greater<int>());
+    for (size_t i = 0; i < count; ++i) rs.remove(ready[i]);
 }
 
-void ReservationStation::ExecuteLSB(State *cur_state, State *next_state) {
-    // Data already in RS  ====> address unit(摆烂了，这里直接算出来) =====> write back (ROB LSB)
-    for (int i = 0; i < lsb_rs.size(); i++) {
-        if (lsb_rs.busy(i)) {
-            if (lsb_rs[i].ins.opc == OpClass::LOAD) {
-                // rd <== mem[rs1(vj) + imm(vk)]
-                if (lsb_rs[i].qj == -1 && lsb_rs[i].qk == -1) {
-                    if (cd_bus->e.full()) throw std::runtime_error("CdBus Full");
-                    cd_bus->e.insert(BusInter{
-                        BusType::GetAddr,
-                        lsb_rs[i].vj + lsb_rs[i].vk,
-                        lsb_rs[i].rob_pos
-                    });
-                    lsb_rs.remove(i);
-                    return ;
-                }
-            } else { // STORE
-                // mem[rs1(vj) + imm(imm)] <== rs2(vk)
-                if (lsb_rs[i].qj == -1 && lsb_rs[i].qk == -1) {
-                    if (cd_bus->e.full()) throw std::runtime_error("CdBus Full");
-                    cd_bus->e.insert(BusInter{
-                        BusType::GetAddr,
-                        lsb_rs[i].vj + lsb_rs[i].imm,
-                        lsb_rs[i].rob_pos
-                    });
-                    if (cd_bus->e.full()) throw std::runtime_error("CdBus Full");
-                    cd_bus->e.insert(BusInter{
-                        BusType::WriteBack,
-                        lsb_rs[i].vk,
-                        lsb_rs[i].rob_pos
-                    });
-                    lsb_rs.remove(i);
-                    return ;
-                }
-            }
-        }
-    }
+template <typename Config>
+void ReservationStation<Config>::ExecuteALU(State *cur_state, State *next_state) {
+    Select(alu_add_rs, cur_state->alu_add_free, next_state->alu_add_inters);
+    Select(alu_camp_rs, cur_state->alu_camp_free, next_state->alu_camp_inters);
+    Select(alu_logic_rs, cur_state->alu_logic_free, next_state->alu_logic_inters);
+    Select(alu_shift_rs, cur_state->alu_shift_free, next_state->alu_shift_inters);
+    Select(alu_mul_rs, cur_state->alu_mul_free, next_state->alu_mul_inters);
+    Select(alu_div_rs, cur_state->alu_div_free, next_state->alu_div_inters);
+}
+
+template <typename Config>
+void ReservationStation<Config>::ExecuteLSB(State *cur_state, State *next_state) {
+    // Data already in RS  ====> address unit =====> LSB (address), ROB LSB (data of a STORE)
+    Select(lsb_rs, cur_state->agu_free, next_state->agu_inters);
 }
 
+#define INSTANTIATE_RESERVATION_STATION(Config, name) template class ReservationStation<Config>;
+FOR_EACH_INSTANTIATED_CONFIG(INSTANTIATE_RESERVATION_STATION)
+#undef INSTANTIATE_RESERVATION_STATION
 
 } // namespace jasonfxz
\ No newline at end of file
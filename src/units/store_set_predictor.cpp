@@ -0,0 +1,41 @@
+#include "units/store_set_predictor.h"
+#include <algorithm>
+
+namespace jasonfxz {
+
+void StoreSetPredictor::Tick() {
+    if (++tick < CLEAR_PERIOD) return;
+    tick = 0;
+    std::fill(ssit.begin(), ssit.end(), -1);
+}
+
+SeqType StoreSetPredictor::Load(AddrType pc) {
+    if (!Enabled()) return -1;
+    Tick();
+    int set = Entry(pc);
+    return set == -1 ? -1 : lfst[set];
+}
+
+int StoreSetPredictor::Store(AddrType pc, SeqType seq) {
+    if (!Enabled()) return -1;
+    Tick();
+    int set = Entry(pc);
+    if (set != -1) lfst[set] = seq;
+    return set;
+}
+
+void StoreSetPredictor::Violation(AddrType load_pc, AddrType store_pc) {
+    if (!Enabled()) return;
+    int &load_set = Entry(load_pc), &store_set = Entry(store_pc);
+    if (load_set == -1 && store_set == -1) {
+        load_set = store_set = (load_pc >> 2) & (lfst.size() - 1);
+    } else if (load_set == -1) {
+        load_set = store_set;
+    } else if (store_set == -1) {
+        store_set = load_set;
+    } else {
+        load_set = store_set = std::min(load_set, store_set);
+    }
+}
+
+} // namespace jasonfxz
@@ -0,0 +1,200 @@
+#include "units/target_predictor.h"
+#include "config/types.h"
+#include "units/branch_predictor.h"
+#include <iomanip>
+#include <sstream>
+
+namespace jasonfxz {
+
+void ReturnAddressStack::Push(AddrType addr) {
+    if (stack.empty()) return;
+    stack[top] = addr;
+    top = (top + 1) % stack.size();
+    if (count < (int)stack.size()) ++count;
+}
+
+bool ReturnAddressStack::Pop(AddrType &addr) {
+    if (count == 0) return false;
+    top = (top + stack.size() - 1) % stack.size();
+    --count;
+    addr = stack[top];
+    return true;
+}
+
+bool BranchTargetBuffer::Lookup(AddrType pc, AddrType &target) const {
+    if (table.empty()) return false;
+    const auto &entry = table[(pc >> 2) & (table.size() - 1)];
+    if (!entry.valid || entry.pc != pc) return false;
+    target = entry.target;
+    return true;
+}
+
+void BranchTargetBuffer::Update(AddrType pc, AddrType target) {
+    if (table.empty()) return;
+    table[(pc >> 2) & (table.size() - 1)] = Entry{true, pc, target};
+}
+
+IttagePredictor::IttagePredictor(int size) {
+    while ((1 << index_bits) < size) ++index_bits;
+    for (auto &table : tables) table.resize(size);
+}
+
+IttagePredictor::Find IttagePredictor::Search(AddrType pc, uint64_t history) const {
+    Find find;
+    uint32_t addr = pc >> 2;
+    for (int i = 0; i < TABLES; ++i) {
+        int len = HISTORY_LENGTH[i];
+        find.index[i] = (addr ^ (addr >> index_bits) ^ Fold(history, len, index_bits)) & ((1U << index_bits) - 1);
+        find.tag[i] = (addr ^ Fold(history, len, TAG_BITS) ^ (Fold(history, len, TAG_BITS - 1) << 1))
+                      & ((1U << TAG_BITS) - 1);
+    }
+    for (int i = TABLES - 1; i >= 0; --i) {
+        const auto &entry = tables[i][find.index[i]];
+        if (!entry.valid || entry.tag != find.tag[i]) continue;
+        if (find.provider == -1) {
+            find.provider = i;
+        } else {
+            find.alt = i;
+            break;
+        }
+    }
+    return find;
+}
+
+int IttagePredictor::Chosen(const Find &find) const {
+    if (find.provider != -1 && find.alt != -1 && tables[find.provider][find.index[find.provider]].ctr == 0) {
+        return find.alt;
+    }
+    return find.provider;
+}
+
+bool IttagePredictor::Lookup(AddrType pc, uint64_t history, AddrType &target) const {
+    if (tables[0].empty()) return false;
+    auto find = Search(pc, history);
+    int chosen = Chosen(find);
+    if (chosen == -1) return false;
+    target = tables[chosen][find.index[chosen]].target;
+    return true;
+}
+
+void IttagePredictor::Update(AddrType pc, uint64_t history, AddrType target, bool base_ok) {
+    if (tables[0].empty()) return;
+    auto find = Search(pc, history);
+    int chosen = Chosen(find);
+    bool ok = chosen == -1 ? base_ok : tables[chosen][find.index[chosen]].target == target;
+    if (find.provider != -1) {
+        auto &entry = tables[find.provider][find.index[find.provider]];
+        bool provider_ok = entry.target == target;
+        bool alt_ok = find.alt == -1 ? base_ok : tables[find.alt][find.index[find.alt]].target == target;
+        if (provider_ok != alt_ok) {
+            if (provider_ok) {
+                if (entry.u < 3) ++entry.u;
+            } else {
+                if (entry.u > 0) --entry.u;
+            }
+        }
+        if (provider_ok) {
+            if (entry.ctr < 3) ++entry.ctr;
+        } else if (entry.ctr > 0) {
+            --entry.ctr;
+        } else {
+            entry.target = target;
+        }
+    }
+    // allocate in a longer history table on a misprediction
+    if (!ok) {
+        bool allocated = false;
+        for (int i = find.provider + 1; i < TABLES && !allocated; ++i) {
+            auto &entry = tables[i][find.index[i]];
+            if (entry.u == 0) {
+                entry = Entry{true, find.tag[i], target, 0, 0};
+                allocated = true;
+            }
+        }
+        if (!allocated) {
+            for (int i = find.provider + 1; i < TABLES; ++i) {
+                auto &entry = tables[i][find.index[i]];
+                if (entry.u > 0) --entry.u;
+            }
+        }
+    }
+    if (++tick == USEFUL_RESET_PERIOD) {
+        tick = 0;
+        for (auto &table : tables) {
+            for (auto &entry : table) entry.u >>= 1;
+        }
+    }
+}
+
+static bool IsCall(const InsType &ins) { return ins.rd == reName::ra; }
+static bool IsReturn(const InsType &ins) {
+    return ins.opt == JALR && ins.rd == reName::zero && ins.rs1 == reName::ra;
+}
+
+void TargetPredictor::Predict(InsType &ins) {
+    if (ins.opt == JALR) {
+        if (IsReturn(ins)) {
+            ins.ras_pop = true;
+            ins.target_predicted = spec_ras.Pop(ins.target);
+        } else {
+            ins.target_ittage = ittage.Lookup(ins.ins_addr, spec_path, ins.target);
+            ins.target_predicted = ins.target_ittage || btb.Lookup(ins.ins_addr, ins.target);
+        }
+        if (ins.target_predicted) spec_path = PathWith(spec_path, ins.target);
+    }
+    if (IsCall(ins)) {
+        ins.ras_push = true;
+        spec_ras.Push(ins.ins_addr + 4);
+    }
+}
+
+void TargetPredictor::Commit(const InsType &ins, AddrType target) {
+    if (ins.ras_pop) {
+        AddrType addr;
+        commit_ras.Pop(addr);
+    }
+    if (ins.ras_push) commit_ras.Push(ins.ins_addr + 4);
+    if (ins.opt != JALR) return;
+    ++jalr_count;
+    bool hit = ins.target_predicted && ins.target == target;
+    if (ins.ras_pop) {
+        ras_predicted += ins.target_predicted;
+        ras_hits += hit;
+    } else {
+        AddrType base;
+        bool base_ok = btb.Lookup(ins.ins_addr, base) && base == target;
+        ittage.Update(ins.ins_addr, commit_path, target, base_ok);
+        if (ins.target_ittage) {
+            ++ittage_predicted;
+            ittage_hits += hit;
+        } else {
+            btb_predicted += ins.target_predicted;
+            btb_hits += hit;
+        }
+        btb.Update(ins.ins_addr, target);
+        auto &site = sites[ins.ins_addr];
+        ++site.count;
+        site.miss += !hit;
+    }
+    commit_path = PathWith(commit_path, target);
+    // fetch waited for this one, so nothing younger has touched the speculative path
+    if (!ins.target_predicted) spec_path = commit_path;
+}
+
+void TargetPredictor::PrintStats(std::ostream &os) const {
+    os << "jalr = " << jalr_count << std::endl;
+    os << "jalr_ras_predicted = " << ras_predicted << std::endl;
+    os << "jalr_ras_hits = " << ras_hits << std::endl;
+    os << "jalr_btb_predicted = " << btb_predicted << std::endl;
+    os << "jalr_btb_hits = " << btb_hits << std::endl;
+    os << "jalr_ittage_predicted = " << ittage_predicted << std::endl;
+    os << "jalr_ittage_hits = " << ittage_hits << std::endl;
+    for (const auto &[pc, site] : sites) {
+        std::ostringstream key;
+        key << "jalr_site." << std::hex << std::setw(8) << std::setfill('0') << pc;
+        os << key.str() << ".count = " << site.count << std::endl;
+        os << key.str() << ".miss = " << site.miss << std::endl;
+    }
+}
+
+} // namespace jasonfxz
@@ -95,6 +95,14 @@ std::string OpcodeToStr(OpType opt) {
     case SRA: return "SRA";
     case OR: return "OR";
     case AND: return "AND";
+    case MUL: return "MUL";
+    case MULH: return "MULH";
+    case MULHSU: return "MULHSU";
+    case MULHU: return "MULHU";
+    case DIV: return "DIV";
+    case DIVU: return "DIVU";
+    case REM: return "REM";
+    case REMU: return "REMU";
     default: return "NONE";
     }
 }
@@ -102,10 +110,10 @@ std::string OpcodeToStr(OpType opt) {
 std::string BusTypeToStr(BusType type) {
     switch (type) {
     case BusType::WriteBack: return "WriteBack";  // Write back to ROB (Load / ALU)
-    case BusType::GetAddr: return "GetAddr";    // Get address for LSB
     case BusType::CommitReg: return "CommitReg";     // ROB Commit to register file
     case BusType::CommitMem: return "CommitMem";   // Store to memory
     case BusType::StoreSuccess: return "StoreSuccess";  // Store success
+    case BusType::JumpTarget: return "JumpTarget";  // Target of a JALR
     default: return "NONE";
     };
 }
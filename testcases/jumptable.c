@@ -0,0 +1,26 @@
+#include "io.inc"
+
+// A tiny bytecode interpreter: the switch is dispatched through a jump table,
+// one indirect jump whose target follows the bytecode.
+// There is no RV32I C compiler around, jumptable.dump is this file compiled by hand.
+
+unsigned prog[16] = {0, 1, 2, 3, 1, 4, 5, 2, 6, 7, 0, 3, 5, 6, 4, 7};
+
+int main() {
+  unsigned acc = 1, x = 7;
+  for (int round = 0; round < 2000; ++round) {
+    for (int pc = 0; pc < 16; ++pc) {
+      switch (prog[pc]) {
+      case 0: acc = acc + x; break;
+      case 1: acc = acc ^ (x << 3); break;
+      case 2: acc = acc - 17; break;
+      case 3: x = x + acc; break;
+      case 4: acc = (acc >> 2) + 3; break;
+      case 5: x = x ^ acc; break;
+      case 6: acc = acc + (acc << 1); break;
+      case 7: printInt(acc); break;
+      }
+    }
+  }
+  return judgeResult % Mod;
+}
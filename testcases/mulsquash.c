@@ -0,0 +1,21 @@
+#include "io.inc"
+
+// A MUL that waits for a long chain of adds, a branch that waits for a shorter
+// one, and behind the branch a MUL whose operands are ready at once. The younger
+// MUL starts first and is done just as the branch turns out to jump over it, so
+// it is squashed while it asks for the CDB, with the older MUL behind it.
+// There is no RV32IM C compiler around, mulsquash.dump is this file compiled by
+// hand, the adds kept one by one for the timing.
+
+int main() {
+  int sum = 0, k = 5, odd = 0;
+  for (int i = 0; i < 1000; ++i) {
+    int t = i + 1 + 2 + 3 + 4 + 5;
+    int p = t * t;
+    if (odd + 0 + 0 != 0) sum += k * k;
+    sum += p;
+    odd ^= 1;
+  }
+  printInt(sum);
+  return judgeResult % Mod;
+}
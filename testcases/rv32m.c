@@ -0,0 +1,52 @@
+#include "io.inc"
+
+// The RV32M instructions, with the cases that do not trap: division by zero
+// and INT_MIN / -1. Every helper below is the one instruction of its name.
+// There is no RV32IM C compiler around, rv32m.dump is this file compiled by hand.
+
+int mulh(int a, int b) { return (long long)a * b >> 32; }
+int mulhsu(int a, unsigned b) { return (long long)a * b >> 32; }
+unsigned mulhu(unsigned a, unsigned b) { return (unsigned long long)a * b >> 32; }
+
+int div(int a, int b) {
+  if (b == 0) return -1;
+  if (a == -2147483647 - 1 && b == -1) return a;
+  return a / b;
+}
+int rem(int a, int b) {
+  if (b == 0) return a;
+  if (a == -2147483647 - 1 && b == -1) return 0;
+  return a % b;
+}
+unsigned divu(unsigned a, unsigned b) { return b == 0 ? 4294967295u : a / b; }
+unsigned remu(unsigned a, unsigned b) { return b == 0 ? a : a % b; }
+
+int main() {
+  unsigned x = 0x12345;
+  int y = -7;
+  for (int i = 0; i < 200; ++i) {
+    printInt(x * i);
+    printInt(mulh(x, y));
+    printInt(mulhsu(y, x));
+    printInt(mulhu(y, x));
+    printInt(div(x, i - 3)); // by zero at i == 3
+    printInt(divu(y, i - 3));
+    printInt(rem(y, i - 3));
+    printInt(remu(x, i - 3));
+    if (judgeResult & 1) x += mulh(x, x); // hard to predict, squashes the MULs in flight
+    x = x * y + 13;
+  }
+  int min = -2147483647 - 1;
+  printInt(div(min, -1));
+  printInt(rem(min, -1));
+  printInt(divu(min, -1));
+  printInt(remu(min, -1));
+  printInt(mulh(min, min));
+  printInt(mulhsu(min, -1));
+  printInt(mulhu(min, -1));
+  printInt(div(min, 0));
+  printInt(rem(min, 0));
+  printInt(divu(-1, 0));
+  printInt(remu(-1, 0));
+  return judgeResult % Mod;
+}